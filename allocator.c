@@ -0,0 +1,181 @@
+#include "allocator.h"
+#include <stdlib.h>
+#include <string.h>
+
+// blocks are carved after the page header, keep them aligned to the granularity
+#define PAGE_HEADER_SIZE ((sizeof(AllocatorPage) + ALLOCATOR_GRANULARITY - 1) & ~(size_t)(ALLOCATOR_GRANULARITY - 1))
+
+static int size_class(const size_t size)
+{
+    return (int)((size - 1) / ALLOCATOR_GRANULARITY);
+}
+
+static void* pool_alloc(Allocator* allocator, const int class_index)
+{
+    AllocatorPool* pool = &allocator->pools[class_index];
+    const size_t block_size = (size_t)(class_index + 1) * ALLOCATOR_GRANULARITY;
+
+    // reuse a freed block first
+    if (pool->free_list != NULL)
+    {
+        void* block = pool->free_list;
+        pool->free_list = *(void**)block;
+        return block;
+    }
+
+    // carve blocks lazily from the current page so untouched memory is never paged in
+    if (pool->bump == NULL || pool->bump + block_size > pool->bump_end)
+    {
+        AllocatorPage* page = malloc(ALLOCATOR_PAGE_SIZE);
+        if (page == NULL)
+            return NULL;
+
+        page->next = allocator->pages;
+        allocator->pages = page;
+        allocator->stats.reserved_bytes += ALLOCATOR_PAGE_SIZE;
+        allocator->stats.frame_system_allocations++;
+        allocator->stats.total_system_allocations++;
+
+        pool->bump = (char*)page + PAGE_HEADER_SIZE;
+        pool->bump_end = (char*)page + ALLOCATOR_PAGE_SIZE;
+    }
+
+    void* block = pool->bump;
+    pool->bump += block_size;
+    return block;
+}
+
+static void pool_free(Allocator* allocator, void* block, const int class_index)
+{
+    AllocatorPool* pool = &allocator->pools[class_index];
+    *(void**)block = pool->free_list;
+    pool->free_list = block;
+}
+
+static void* block_alloc(Allocator* allocator, const size_t size)
+{
+    allocator->stats.frame_allocations++;
+    allocator->stats.total_allocations++;
+
+    if (size <= ALLOCATOR_SMALL_LIMIT)
+        return pool_alloc(allocator, size_class(size));
+
+    allocator->stats.frame_system_allocations++;
+    allocator->stats.total_system_allocations++;
+    return malloc(size);
+}
+
+static void block_free(Allocator* allocator, void* block, const size_t size)
+{
+    if (size <= ALLOCATOR_SMALL_LIMIT)
+        pool_free(allocator, block, size_class(size));
+    else
+        free(block);
+}
+
+// a system block past the pool range serves as a pool block from now on, its link sits just past the largest class
+// so it never overlaps what Lua stores, and allocator_destroy hands the block back to free
+#define ADOPTED_BLOCK_SIZE (ALLOCATOR_SMALL_LIMIT + sizeof(AllocatorPage))
+
+static void* adopt_block(Allocator* allocator, void* ptr, const size_t osize)
+{
+    void* block = realloc(ptr, ADOPTED_BLOCK_SIZE);
+    if (block == NULL)
+    {
+        if (osize < ADOPTED_BLOCK_SIZE)
+            return NULL;
+        block = ptr;
+    }
+
+    AllocatorPage* link = (AllocatorPage*)((char*)block + ALLOCATOR_SMALL_LIMIT);
+    link->next = allocator->adopted;
+    allocator->adopted = link;
+    return block;
+}
+
+void allocator_initialise(Allocator* allocator)
+{
+    memset(allocator, 0, sizeof(Allocator));
+}
+
+void allocator_destroy(Allocator* allocator)
+{
+    AllocatorPage* page = allocator->pages;
+    while (page != NULL)
+    {
+        AllocatorPage* next = page->next;
+        free(page);
+        page = next;
+    }
+
+    AllocatorPage* link = allocator->adopted;
+    while (link != NULL)
+    {
+        AllocatorPage* next = link->next;
+        free((char*)link - ALLOCATOR_SMALL_LIMIT);
+        link = next;
+    }
+
+    allocator_initialise(allocator);
+}
+
+void allocator_begin_frame(Allocator* allocator)
+{
+    allocator->stats.frame_allocations = 0;
+    allocator->stats.frame_system_allocations = 0;
+}
+
+void* allocator_lua_alloc(void* ud, void* ptr, const size_t osize, const size_t nsize)
+{
+    Allocator* allocator = ud;
+    void* result = NULL;
+
+    if (nsize == 0)
+    {
+        // Lua passes the exact old size, so a freed block can go back to its pool without a header
+        if (ptr != NULL)
+            block_free(allocator, ptr, osize);
+    }
+    else if (ptr == NULL)
+    {
+        result = block_alloc(allocator, nsize);
+    }
+    else if (osize <= ALLOCATOR_SMALL_LIMIT && nsize <= ALLOCATOR_SMALL_LIMIT && size_class(osize) == size_class(nsize))
+    {
+        // still fits the same block
+        result = ptr;
+    }
+    else if (osize > ALLOCATOR_SMALL_LIMIT && nsize > ALLOCATOR_SMALL_LIMIT)
+    {
+        allocator->stats.frame_system_allocations++;
+        allocator->stats.total_system_allocations++;
+        result = realloc(ptr, nsize);
+    }
+    else
+    {
+        // moving between a pool and the system allocator, or between two pools
+        result = block_alloc(allocator, nsize);
+        if (result != NULL)
+        {
+            memcpy(result, ptr, osize < nsize ? osize : nsize);
+            block_free(allocator, ptr, osize);
+        }
+        else if (nsize < osize)
+        {
+            // Lua shrinks during collection and cannot handle a failure there, so the old block is kept,
+            // a pool block can later go back to the smaller pool Lua will free it to but a system block has
+            // to be tracked so it is not lost on a free list that allocator_destroy never frees
+            result = osize <= ALLOCATOR_SMALL_LIMIT ? ptr : adopt_block(allocator, ptr, osize);
+        }
+    }
+
+    if (nsize == 0 || result != NULL)
+    {
+        AllocatorStats* stats = &allocator->stats;
+        stats->live_bytes = stats->live_bytes + nsize - (ptr != NULL ? osize : 0);
+        if (stats->live_bytes > stats->peak_bytes)
+            stats->peak_bytes = stats->live_bytes;
+    }
+
+    return result;
+}
@@ -0,0 +1,55 @@
+#ifndef ALLOCATOR_H
+#define ALLOCATOR_H
+
+#include <stddef.h>
+
+// small blocks are rounded up to a multiple of the granularity and served from a pool per size class,
+// anything larger than the last class goes straight to the system allocator
+#define ALLOCATOR_GRANULARITY 16
+#define ALLOCATOR_CLASS_COUNT 16
+#define ALLOCATOR_SMALL_LIMIT (ALLOCATOR_GRANULARITY * ALLOCATOR_CLASS_COUNT)
+#define ALLOCATOR_PAGE_SIZE (64 * 1024)
+
+typedef struct AllocatorPage
+{
+    struct AllocatorPage* next;
+} AllocatorPage;
+
+typedef struct AllocatorPool
+{
+    void* free_list;
+    char* bump;
+    char* bump_end;
+} AllocatorPool;
+
+typedef struct AllocatorStats
+{
+    size_t live_bytes;
+    size_t peak_bytes;
+    size_t reserved_bytes;
+    size_t frame_allocations;
+    size_t frame_system_allocations;
+    size_t total_allocations;
+    size_t total_system_allocations;
+} AllocatorStats;
+
+// an allocator is owned by exactly one lua_State and is only touched by the thread running that state,
+// which keeps its pools thread-local without any locking
+typedef struct Allocator
+{
+    AllocatorPool pools[ALLOCATOR_CLASS_COUNT];
+    AllocatorPage* pages;
+
+    // system blocks that became pool blocks when shrinking into a pool failed, linked through their unused tail
+    AllocatorPage* adopted;
+    AllocatorStats stats;
+} Allocator;
+
+void allocator_initialise(Allocator* allocator);
+void allocator_destroy(Allocator* allocator);
+void allocator_begin_frame(Allocator* allocator);
+
+// lua_Alloc compatible function, pass the Allocator as the userdata to lua_newstate
+void* allocator_lua_alloc(void* ud, void* ptr, size_t osize, size_t nsize);
+
+#endif //ALLOCATOR_H
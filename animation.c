@@ -0,0 +1,458 @@
+#include "animation.h"
+#include "bindings.h"
+#include "frame.h"
+#include "telemetry.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// live animators in creation order, which is also the order animators_draw uses
+static Animator** animators = NULL;
+static int animator_count = 0;
+static int animator_capacity = 0;
+static bool holes = false;
+
+// MARK: Internal Functions
+
+static void compact_animators(void);
+
+static void add_animator(Animator* animator)
+{
+    if (holes)
+        compact_animators();
+
+    if (animator_count == animator_capacity)
+    {
+        animator_capacity = animator_capacity == 0 ? 64 : animator_capacity * 2;
+        animators = realloc(animators, sizeof(Animator*) * animator_capacity);
+    }
+
+    animator->index = animator_count;
+    animators[animator_count++] = animator;
+}
+
+static void remove_animator(const Animator* animator)
+{
+    // leave a hole that the next update compacts, so collecting many animators at once stays linear
+    animators[animator->index] = NULL;
+    holes = true;
+}
+
+static void compact_animators(void)
+{
+    // keeps the remaining animators in order so draw order does not change when one is collected
+    int count = 0;
+    for (int i = 0; i < animator_count; ++i)
+    {
+        if (animators[i] == NULL)
+            continue;
+
+        animators[i]->index = count;
+        animators[count++] = animators[i];
+    }
+
+    animator_count = count;
+    holes = false;
+
+    if (animator_count == 0)
+    {
+        free(animators);
+        animators = NULL;
+        animator_capacity = 0;
+    }
+}
+
+// jumps any number of frames at once, so a long frame or a huge speed costs the same as a single step
+static void skip_frames(Animator* animator, const AnimationClip* clip, const double steps)
+{
+    const int length = clip->last - clip->first + 1;
+
+    switch (clip->mode)
+    {
+    case ANIMATION_ONCE:
+        // one step past the last frame is what finishes the clip
+        if (steps > (double)(clip->last - animator->frame))
+        {
+            animator->frame = clip->last;
+            animator->playing = false;
+            animator->finished = true;
+        }
+        else
+        {
+            animator->frame += (int)steps;
+        }
+        break;
+    case ANIMATION_LOOP:
+        animator->frame = clip->first + (int)fmod((double)(animator->frame - clip->first) + fmod(steps, length), length);
+        break;
+    case ANIMATION_PING_PONG:
+    {
+        if (length == 1)
+            break;
+
+        // a forward and a backward pass form one period, the last frame is only shown on the way forward
+        const int period = 2 * (length - 1);
+        const int offset = animator->frame - clip->first;
+        const int phase = animator->direction > 0 ? offset : period - offset;
+        const int next = (int)fmod((double)phase + fmod(steps, period), period);
+
+        if (next <= length - 1)
+        {
+            animator->frame = clip->first + next;
+            animator->direction = 1;
+        }
+        else
+        {
+            animator->frame = clip->first + period - next;
+            animator->direction = -1;
+        }
+        break;
+    }
+    }
+}
+
+static void advance_animator(Animator* animator, const float dt)
+{
+    if (!animator->playing || animator->clip_count == 0)
+        return;
+
+    const AnimationClip* clip = &animator->clips[animator->clip];
+    animator->elapsed += dt * animator->speed;
+
+    if (animator->elapsed < clip->frame_duration)
+        return;
+
+    const double steps = floor(animator->elapsed / clip->frame_duration);
+    animator->elapsed = fmodf(animator->elapsed, clip->frame_duration);
+    skip_frames(animator, clip, steps);
+}
+
+static void draw_animator(const Animator* animator)
+{
+    const Texture2D* image = animator->image;
+    const float width = (float)(image->width / animator->cols);
+    const float height = (float)(image->height / animator->rows);
+
+    const Rectangle source = {
+        (float)(animator->frame % animator->cols) * width,
+        (float)(animator->frame / animator->cols) * height,
+        animator->flip_x ? -width : width,
+        animator->flip_y ? -height : height
+    };
+    const Rectangle dest = {animator->position.x, animator->position.y, width * animator->scale.x, height * animator->scale.y};
+
+    // consecutive draws from the same image share a single rlgl batch
+    DrawTexturePro(*image, source, dest, (Vector2){0, 0}, animator->rotation, animator->tint);
+}
+
+static int find_clip(const Animator* animator, const char* name)
+{
+    for (int i = 0; i < animator->clip_count; ++i)
+    {
+        if (strcmp(animator->clips[i].name, name) == 0)
+            return i;
+    }
+    return -1;
+}
+
+void animation_update(const float dt)
+{
+    if (holes)
+        compact_animators();
+
+    bool playing = false;
+    for (int i = 0; i < animator_count; ++i)
+    {
+        advance_animator(animators[i], dt);
+        playing |= animators[i]->playing;
+    }
+
+    // a reactive screen has to keep drawing while anything is still animating
+    if (playing)
+        frame_request();
+}
+
+// MARK: Animator Functions
+
+static Animator* cmt_check_animator(lua_State* L, const int idx)
+{
+    return luaL_checkudata(L, idx, "__mt_animator");
+}
+
+static int cmt_animator_new(lua_State* L)
+{
+    const Texture2D* image = cmt_check_image(L, 1, "image");
+    const lua_Integer rows = luaL_checkinteger(L, 2);
+    const lua_Integer cols = luaL_checkinteger(L, 3);
+    luaL_argcheck(L, rows > 0, 2, "rows must be greater than zero");
+    luaL_argcheck(L, cols > 0, 3, "cols must be greater than zero");
+
+    Animator* animator = lua_newuserdata(L, sizeof(Animator));
+    memset(animator, 0, sizeof(Animator));
+    animator->image = image;
+    animator->rows = (int)rows;
+    animator->cols = (int)cols;
+    animator->direction = 1;
+    animator->speed = 1;
+    animator->scale = (Vector2){1, 1};
+    animator->visible = true;
+    animator->tint = WHITE;
+
+    luaL_getmetatable(L, "__mt_animator");
+    lua_setmetatable(L, -2);
+
+    // the environment table holds a reference to the image so it outlives the animator
+    lua_createtable(L, 1, 0);
+    lua_pushvalue(L, 1);
+    lua_rawseti(L, -2, 1);
+    lua_setfenv(L, -2);
+
+    add_animator(animator);
+    telemetry_userdata_created(TELEMETRY_ANIMATOR);
+    return 1;
+}
+
+static int cmt_animator_gc(lua_State* L)
+{
+    const Animator* animator = cmt_check_animator(L, 1);
+    remove_animator(animator);
+    return 0;
+}
+
+static int cmt_animator_add_clip(lua_State* L)
+{
+    static const char* const modes[] = {"once", "loop", "ping_pong", NULL};
+
+    Animator* animator = cmt_check_animator(L, 1);
+    const char* name = luaL_checkstring(L, 2);
+    const lua_Integer first = luaL_checkinteger(L, 3);
+    const lua_Integer last = luaL_checkinteger(L, 4);
+    const lua_Number frame_duration = luaL_checknumber(L, 5);
+    const int mode = luaL_checkoption(L, 6, "loop", modes);
+
+    const int frame_count = animator->rows * animator->cols;
+    luaL_argcheck(L, strlen(name) < ANIMATOR_CLIP_NAME_LENGTH, 2, "clip name is too long");
+    luaL_argcheck(L, first >= 1 && first <= frame_count, 3, "frame is out of range");
+    luaL_argcheck(L, last >= first && last <= frame_count, 4, "frame is out of range");
+    luaL_argcheck(L, frame_duration > 0, 5, "frame duration must be greater than zero");
+
+    int clip_index = find_clip(animator, name);
+    if (clip_index == -1)
+    {
+        if (animator->clip_count == ANIMATOR_MAX_CLIPS)
+            return luaL_error(L, "animator_add_clip failed, animators can hold at most %d clips", ANIMATOR_MAX_CLIPS);
+        clip_index = animator->clip_count++;
+    }
+
+    // frames are 1-based in Lua to match the image_split_regions table
+    AnimationClip* clip = &animator->clips[clip_index];
+    strcpy(clip->name, name);
+    clip->first = (int)first - 1;
+    clip->last = (int)last - 1;
+    clip->frame_duration = (float)frame_duration;
+    clip->mode = (AnimationMode)mode;
+
+    // the first clip added becomes the current one
+    if (animator->clip_count == 1)
+        animator->frame = clip->first;
+
+    return 0;
+}
+
+static int cmt_animator_play(lua_State* L)
+{
+    Animator* animator = cmt_check_animator(L, 1);
+    const char* name = luaL_checkstring(L, 2);
+    const bool restart = lua_toboolean(L, 3);
+
+    const int clip_index = find_clip(animator, name);
+    if (clip_index == -1)
+        return luaL_error(L, "Animator has no clip \"%s\".", name);
+
+    // playing the current clip again keeps its progress unless asked to restart
+    if (clip_index != animator->clip || restart || animator->finished)
+    {
+        animator->clip = clip_index;
+        animator->frame = animator->clips[clip_index].first;
+        animator->direction = 1;
+        animator->elapsed = 0;
+        animator->finished = false;
+    }
+
+    animator->playing = true;
+    return 0;
+}
+
+static int cmt_animator_stop(lua_State* L)
+{
+    Animator* animator = cmt_check_animator(L, 1);
+    animator->playing = false;
+    return 0;
+}
+
+static int cmt_animator_draw(lua_State* L)
+{
+    const Animator* animator = cmt_check_animator(L, 1);
+    draw_animator(animator);
+    return 0;
+}
+
+static int cmt_animators_draw(lua_State* L)
+{
+    for (int i = 0; i < animator_count; ++i)
+    {
+        if (animators[i] != NULL && animators[i]->visible)
+            draw_animator(animators[i]);
+    }
+    return 0;
+}
+
+static int cmt_animator_index(lua_State* L)
+{
+    const Animator* animator = cmt_check_animator(L, 1);
+    const char* key = luaL_checkstring(L, 2);
+
+    if (strcmp(key, "x") == 0)
+    {
+        lua_pushnumber(L, animator->position.x);
+    }
+    else if (strcmp(key, "y") == 0)
+    {
+        lua_pushnumber(L, animator->position.y);
+    }
+    else if (strcmp(key, "rotation") == 0)
+    {
+        lua_pushnumber(L, animator->rotation);
+    }
+    else if (strcmp(key, "scale_x") == 0)
+    {
+        lua_pushnumber(L, animator->scale.x);
+    }
+    else if (strcmp(key, "scale_y") == 0)
+    {
+        lua_pushnumber(L, animator->scale.y);
+    }
+    else if (strcmp(key, "flip_x") == 0)
+    {
+        lua_pushboolean(L, animator->flip_x);
+    }
+    else if (strcmp(key, "flip_y") == 0)
+    {
+        lua_pushboolean(L, animator->flip_y);
+    }
+    else if (strcmp(key, "visible") == 0)
+    {
+        lua_pushboolean(L, animator->visible);
+    }
+    else if (strcmp(key, "speed") == 0)
+    {
+        lua_pushnumber(L, animator->speed);
+    }
+    else if (strcmp(key, "tint") == 0)
+    {
+        const Color tint = animator->tint;
+        cmt_color_new_internal(L, tint.r, tint.g, tint.b, tint.a);
+    }
+    else if (strcmp(key, "frame") == 0)
+    {
+        lua_pushinteger(L, animator->frame + 1);
+    }
+    else if (strcmp(key, "clip") == 0)
+    {
+        if (animator->clip_count == 0)
+            lua_pushnil(L);
+        else
+            lua_pushstring(L, animator->clips[animator->clip].name);
+    }
+    else if (strcmp(key, "playing") == 0)
+    {
+        lua_pushboolean(L, animator->playing);
+    }
+    else if (strcmp(key, "finished") == 0)
+    {
+        lua_pushboolean(L, animator->finished);
+    }
+    else
+    {
+        return luaL_error(L, "Animator has no field \"%s\".", key);
+    }
+
+    return 1;
+}
+
+static int cmt_animator_newindex(lua_State* L)
+{
+    Animator* animator = cmt_check_animator(L, 1);
+    const char* key = luaL_checkstring(L, 2);
+
+    if (strcmp(key, "x") == 0)
+    {
+        animator->position.x = (float)luaL_checknumber(L, 3);
+    }
+    else if (strcmp(key, "y") == 0)
+    {
+        animator->position.y = (float)luaL_checknumber(L, 3);
+    }
+    else if (strcmp(key, "rotation") == 0)
+    {
+        animator->rotation = (float)luaL_checknumber(L, 3);
+    }
+    else if (strcmp(key, "scale_x") == 0)
+    {
+        animator->scale.x = (float)luaL_checknumber(L, 3);
+    }
+    else if (strcmp(key, "scale_y") == 0)
+    {
+        animator->scale.y = (float)luaL_checknumber(L, 3);
+    }
+    else if (strcmp(key, "flip_x") == 0)
+    {
+        animator->flip_x = lua_toboolean(L, 3);
+    }
+    else if (strcmp(key, "flip_y") == 0)
+    {
+        animator->flip_y = lua_toboolean(L, 3);
+    }
+    else if (strcmp(key, "visible") == 0)
+    {
+        animator->visible = lua_toboolean(L, 3);
+    }
+    else if (strcmp(key, "speed") == 0)
+    {
+        // an infinite speed would leave elapsed infinite and the frame undefined
+        const float speed = (float)luaL_checknumber(L, 3);
+        luaL_argcheck(L, isfinite(speed), 3, "speed must be finite");
+        animator->speed = speed;
+    }
+    else if (strcmp(key, "tint") == 0)
+    {
+        animator->tint = *cmt_check_color(L, 3, "tint");
+    }
+    else
+    {
+        return luaL_error(L, "Animator has no writable field \"%s\".", key);
+    }
+
+    return 0;
+}
+
+void register_animation_bindings(lua_State* L)
+{
+    lua_register(L, "animator_new", cmt_animator_new);
+    lua_register(L, "animator_add_clip", cmt_animator_add_clip);
+    lua_register(L, "animator_play", cmt_animator_play);
+    lua_register(L, "animator_stop", cmt_animator_stop);
+    lua_register(L, "animator_draw", cmt_animator_draw);
+    lua_register(L, "animators_draw", cmt_animators_draw);
+
+    if (!luaL_newmetatable(L, "__mt_animator"))
+        printf("Lua error: Animator metatable at __mt_animator already exists\n");
+
+    lua_pushcfunction(L, cmt_animator_index);
+    lua_setfield(L, -2, "__index");
+    lua_pushcfunction(L, cmt_animator_newindex);
+    lua_setfield(L, -2, "__newindex");
+    lua_pushcfunction(L, cmt_animator_gc);
+    lua_setfield(L, -2, "__gc");
+    lua_pop(L, 1);
+}
@@ -0,0 +1,62 @@
+#ifndef ANIMATION_H
+#define ANIMATION_H
+
+#include "comet.h"
+
+#define ANIMATOR_MAX_CLIPS 16
+#define ANIMATOR_CLIP_NAME_LENGTH 32
+
+typedef enum AnimationMode
+{
+    ANIMATION_ONCE,
+    ANIMATION_LOOP,
+    ANIMATION_PING_PONG
+} AnimationMode;
+
+typedef struct AnimationClip
+{
+    char name[ANIMATOR_CLIP_NAME_LENGTH];
+    int first;
+    int last;
+    float frame_duration;
+    AnimationMode mode;
+} AnimationClip;
+
+typedef struct Animator
+{
+    // points into the image userdata, which is kept alive through the animator's environment table
+    const Texture2D* image;
+    int rows;
+    int cols;
+
+    AnimationClip clips[ANIMATOR_MAX_CLIPS];
+    int clip_count;
+
+    // playback state
+    int clip;
+    int frame;
+    int direction;
+    float elapsed;
+    float speed;
+    bool playing;
+    bool finished;
+
+    // draw state
+    Vector2 position;
+    Vector2 scale;
+    float rotation;
+    bool flip_x;
+    bool flip_y;
+    bool visible;
+    Color tint;
+
+    // slot in the list of live animators
+    int index;
+} Animator;
+
+// advances every live animator by dt seconds
+void animation_update(float dt);
+
+void register_animation_bindings(lua_State* L);
+
+#endif //ANIMATION_H
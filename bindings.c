@@ -1,4 +1,21 @@
 #include "bindings.h"
+#include "animation.h"
+#include "data.h"
+#include "entity.h"
+#include "frame.h"
+#include "layer.h"
+#include "pack.h"
+#include "pathfinding.h"
+#include "profiler.h"
+#include "scheduler.h"
+#include "serialize.h"
+#include "shapes.h"
+#include "snapshot.h"
+#include "telemetry.h"
+#include "text.h"
+#include "tween.h"
+#include "watchdog.h"
+#include "worker.h"
 #include <string.h>
 #include <stdlib.h>
 #include <math.h>
@@ -12,7 +29,7 @@ Vector2 global_position = {0};
 
 // MARK: Object Check Functions
 
-static Texture2D* cmt_check_image(lua_State* L, const int idx, const char* arg_name)
+Texture2D* cmt_check_image(lua_State* L, const int idx, const char* arg_name)
 {
     Texture2D* image = lua_touserdata(L, idx);
     if (image == NULL)
@@ -20,7 +37,7 @@ static Texture2D* cmt_check_image(lua_State* L, const int idx, const char* arg_n
     return image;
 }
 
-static Color* cmt_check_color(lua_State* L, const int idx, const char* arg_name)
+Color* cmt_check_color(lua_State* L, const int idx, const char* arg_name)
 {
     Color* color = lua_touserdata(L, idx);
     if (color == NULL)
@@ -28,7 +45,7 @@ static Color* cmt_check_color(lua_State* L, const int idx, const char* arg_name)
     return color;
 }
 
-static Rectangle* cmt_check_rect(lua_State* L, const int idx, const char* arg_name)
+Rectangle* cmt_check_rect(lua_State* L, const int idx, const char* arg_name)
 {
     Rectangle* rect = lua_touserdata(L, idx);
     if (rect == NULL)
@@ -36,7 +53,7 @@ static Rectangle* cmt_check_rect(lua_State* L, const int idx, const char* arg_na
     return rect;
 }
 
-static Camera2D* cmt_check_camera(lua_State* L, const int idx, const char* arg_name)
+Camera2D* cmt_check_camera(lua_State* L, const int idx, const char* arg_name)
 {
     Camera2D* cam = lua_touserdata(L, idx);
     if (cam == NULL)
@@ -46,8 +63,8 @@ static Camera2D* cmt_check_camera(lua_State* L, const int idx, const char* arg_n
 
 // MARK: Internal Object Creation Functions
 
-static Rectangle* cmt_rect_new_internal(lua_State* L, const float x, const float y, const float width,
-                                        const float height)
+Rectangle* cmt_rect_new_internal(lua_State* L, const float x, const float y, const float width,
+                                 const float height)
 {
     const Rectangle rect = {x, y, width, height};
     Rectangle* rect_ptr = lua_newuserdata(L, sizeof(Rectangle));
@@ -55,11 +72,12 @@ static Rectangle* cmt_rect_new_internal(lua_State* L, const float x, const float
 
     luaL_getmetatable(L, "__mt_rect");
     lua_setmetatable(L, -2);
+    telemetry_userdata_created(TELEMETRY_RECT);
 
     return rect_ptr;
 }
 
-static Color* cmt_color_new_internal(lua_State* L, const int r, const int g, const int b, const int a)
+Color* cmt_color_new_internal(lua_State* L, const int r, const int g, const int b, const int a)
 {
     const Color color = {r, g, b, a};
     Color* color_ptr = lua_newuserdata(L, sizeof(Color));
@@ -67,12 +85,13 @@ static Color* cmt_color_new_internal(lua_State* L, const int r, const int g, con
 
     luaL_getmetatable(L, "__mt_color");
     lua_setmetatable(L, -2);
+    telemetry_userdata_created(TELEMETRY_COLOR);
 
     return color_ptr;
 }
 
-static Camera2D* cmt_camera_new_internal(lua_State* L, const float x, const float y, const float rotation,
-                                         const float zoom)
+Camera2D* cmt_camera_new_internal(lua_State* L, const float x, const float y, const float rotation,
+                                  const float zoom)
 {
     const Camera2D cam = {-x, -y, 0, 0, rotation, zoom};
     Camera2D* cam_ptr = lua_newuserdata(L, sizeof(Camera2D));
@@ -80,6 +99,7 @@ static Camera2D* cmt_camera_new_internal(lua_State* L, const float x, const floa
 
     luaL_getmetatable(L, "__mt_camera");
     lua_setmetatable(L, -2);
+    telemetry_userdata_created(TELEMETRY_CAMERA);
 
     return cam_ptr;
 }
@@ -93,18 +113,123 @@ static int cmt_clear_background(lua_State* L)
     return 0;
 }
 
-// MARK: Data Management Functions
+// MARK: Engine Functions
 
-static int cmt_data_load_text(lua_State* L)
+static int cmt_memory_stats(lua_State* L)
 {
-    const char* file_path = luaL_checkstring(L, 1);
-    const char* contents = LoadFileText(file_path);
-    lua_pushstring(L, contents);
+    void* ud = NULL;
+    lua_getallocf(L, &ud);
+    const AllocatorStats* stats = &((Allocator*)ud)->stats;
+
+    lua_createtable(L, 0, 5);
+    lua_pushinteger(L, (lua_Integer)stats->live_bytes);
+    lua_setfield(L, -2, "live_bytes");
+    lua_pushinteger(L, (lua_Integer)stats->peak_bytes);
+    lua_setfield(L, -2, "peak_bytes");
+    lua_pushinteger(L, (lua_Integer)stats->reserved_bytes);
+    lua_setfield(L, -2, "reserved_bytes");
+    lua_pushinteger(L, (lua_Integer)stats->frame_allocations);
+    lua_setfield(L, -2, "frame_allocations");
+    lua_pushinteger(L, (lua_Integer)stats->frame_system_allocations);
+    lua_setfield(L, -2, "frame_system_allocations");
     return 1;
 }
 
 // MARK: Image Functions
 
+// registry reference to a table from normalised path to a weak set of the images loaded from it
+static int image_paths_ref = LUA_NOREF;
+
+static void track_image_path(lua_State* L, const char* file_path, const int idx)
+{
+    lua_rawgeti(L, LUA_REGISTRYINDEX, image_paths_ref);
+    const char* key = pack_normalise_path(file_path);
+    lua_getfield(L, -1, key);
+
+    if (lua_isnil(L, -1))
+    {
+        lua_pop(L, 1);
+        lua_newtable(L);
+
+        // the set must not keep images alive after the script drops them
+        lua_createtable(L, 0, 1);
+        lua_pushliteral(L, "k");
+        lua_setfield(L, -2, "__mode");
+        lua_setmetatable(L, -2);
+
+        lua_pushvalue(L, -1);
+        lua_setfield(L, -3, key);
+    }
+
+    lua_pushvalue(L, idx);
+    lua_pushboolean(L, true);
+    lua_rawset(L, -3);
+    lua_pop(L, 2);
+}
+
+static void swap_texture(Texture2D* texture, const Image image)
+{
+    // same size and format means the new pixels can be uploaded into the existing texture
+    if (texture->width == image.width && texture->height == image.height &&
+        texture->format == image.format && texture->mipmaps == image.mipmaps)
+    {
+        UpdateTexture(*texture, image.data);
+        return;
+    }
+
+    const Texture2D replacement = LoadTextureFromImage(image);
+    if (replacement.id == 0)
+        return;
+
+    telemetry_texture_unloaded(*texture);
+    UnloadTexture(*texture);
+    *texture = replacement;
+    telemetry_texture_loaded(replacement);
+}
+
+int image_reload(lua_State* L, const char* file_path)
+{
+    if (L == NULL || image_paths_ref == LUA_NOREF)
+        return 0;
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, image_paths_ref);
+    lua_getfield(L, -1, pack_normalise_path(file_path));
+    if (!lua_istable(L, -1))
+    {
+        lua_pop(L, 2);
+        return 0;
+    }
+
+    // decoded once, then shared by every image that was loaded from this path
+    const Image image = LoadImage(file_path);
+    if (image.data == NULL)
+    {
+        printf("Image \"%s\" could not be reloaded\n", file_path);
+        lua_pop(L, 2);
+        return 0;
+    }
+
+    int swapped = 0;
+    lua_pushnil(L);
+    while (lua_next(L, -2))
+    {
+        lua_pop(L, 1);
+        Texture2D* texture = lua_touserdata(L, -1);
+        if (texture->id != 0)
+        {
+            swap_texture(texture, image);
+            swapped++;
+        }
+    }
+
+    UnloadImage(image);
+    lua_pop(L, 2);
+
+    if (swapped > 0)
+        frame_request();
+    return swapped;
+}
+
 static int cmt_image_load(lua_State* L)
 {
     const char* file_path = luaL_checkstring(L, 1);
@@ -122,9 +247,27 @@ static int cmt_image_load(lua_State* L)
     luaL_getmetatable(L, "__mt_image");
     lua_setmetatable(L, -2);
 
+    // scripts keep their reference when the file changes, the texture behind it is swapped in place
+    track_image_path(L, file_path, lua_gettop(L));
+
+    telemetry_texture_loaded(texture);
+    telemetry_userdata_created(TELEMETRY_IMAGE);
+
     return 1;
 }
 
+static int cmt_image_gc(lua_State* L)
+{
+    Texture2D* image = cmt_check_image(L, 1, "image");
+    if (image->id != 0)
+    {
+        telemetry_texture_unloaded(*image);
+        UnloadTexture(*image);
+        image->id = 0;
+    }
+    return 0;
+}
+
 static int cmt_image_index(lua_State* L)
 {
     const Texture2D* image = cmt_check_image(L, 1, "image");
@@ -541,14 +684,24 @@ static int cmt_color_newindex(lua_State* L)
     return 0;
 }
 
+static int cmt_panic(lua_State* L)
+{
+    printf("Lua panic: %s\n", lua_tostring(L, -1));
+    return 0;
+}
+
 void initialise_lua(Engine* engine)
 {
-    lua_State* L = luaL_newstate();
+    lua_State* L = lua_newstate(allocator_lua_alloc, &engine->allocator);
     engine->L = L;
+    lua_atpanic(L, cmt_panic);
     luaL_openlibs(L);
 
+    lua_newtable(L);
+    image_paths_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+
     lua_register(L, "clear_background", cmt_clear_background);
-    lua_register(L, "data_load_text", cmt_data_load_text);
+    lua_register(L, "memory_stats", cmt_memory_stats);
     lua_register(L, "image_load", cmt_image_load);
     lua_register(L, "image_split_regions", cmt_image_split_regions);
     lua_register(L, "image_draw", cmt_image_draw);
@@ -564,12 +717,32 @@ void initialise_lua(Engine* engine)
     lua_register(L, "rect_new", cmt_rect_new);
     lua_register(L, "color_new", cmt_color_new);
 
+    register_animation_bindings(L);
+    register_data_bindings(L);
+    register_entity_bindings(L);
+    register_frame_bindings(L);
+    register_layer_bindings(L);
+    register_pack_bindings(L);
+    register_pathfinding_bindings(L);
+    register_profiler_bindings(L);
+    register_scheduler_bindings(L);
+    register_serialize_bindings(L);
+    register_shapes_bindings(L);
+    register_snapshot_bindings(L);
+    register_telemetry_bindings(L);
+    register_text_bindings(L);
+    register_tween_bindings(L);
+    register_watchdog_bindings(L);
+    register_worker_bindings(L);
+
     // set up metamethods
     if (!luaL_newmetatable(L, "__mt_image"))
         printf("Lua error: Image metatable at __mt_image already exists\n");
 
     lua_pushcfunction(L, cmt_image_index);
     lua_setfield(L, -2, "__index");
+    lua_pushcfunction(L, cmt_image_gc);
+    lua_setfield(L, -2, "__gc");
     lua_pop(L, 1);
 
     if (!luaL_newmetatable(L, "__mt_camera"))
@@ -615,15 +788,90 @@ void run_lua_main(Engine* engine)
     lua_State* L = engine->L;
     engine->script_active = true;
 
-    if (luaL_loadfile(L, "/main.lua"))
+    if (pack_load_lua(L, "/main.lua"))
     {
         printf("Lua error: %s\n", lua_tostring(L, -1));
         engine->script_active = false;
     }
 
-    if (engine->script_active && lua_pcall(L, 0, 0, 0))
+    if (engine->script_active)
     {
-        printf("Lua error: %s\n", lua_tostring(L, -1));
-        engine->script_active = false;
+        watchdog_begin("main");
+        if (lua_pcall(L, 0, 0, 0))
+        {
+            printf("Lua error: %s\n", lua_tostring(L, -1));
+            engine->script_active = false;
+        }
+
+        if (watchdog_end())
+            engine->script_active = false;
     }
 }
+
+void close_lua(Engine* engine)
+{
+    if (engine->L != NULL)
+    {
+        profiler_stop(engine->L);
+        lua_close(engine->L);
+        engine->L = NULL;
+    }
+
+    // native systems may still reference objects owned by the closed state
+    engine->script_active = false;
+    image_paths_ref = LUA_NOREF;
+    entity_reset();
+    scheduler_reset();
+    snapshot_reset();
+    text_reset();
+    tween_reset();
+}
+
+void restart_lua(Engine* engine)
+{
+    // the old script can hand state to the new one through on_reload_save and on_reload_restore
+    SerialBuffer saved = {0};
+    bool has_saved = false;
+
+    lua_State* L = engine->L;
+    if (L != NULL && engine->script_active)
+    {
+        lua_getglobal(L, "on_reload_save");
+        if (lua_isfunction(L, -1))
+        {
+            if (lua_pcall(L, 0, 1, 0))
+            {
+                printf("Lua error: %s\n", lua_tostring(L, -1));
+            }
+            else
+            {
+                const char* error = serialize_value(L, -1, &saved);
+                if (error != NULL)
+                    printf("Could not save state for reload: %s\n", error);
+                has_saved = error == NULL;
+            }
+        }
+        lua_settop(L, 0);
+    }
+
+    close_lua(engine);
+    initialise_lua(engine);
+    run_lua_main(engine);
+
+    L = engine->L;
+    if (has_saved && engine->script_active)
+    {
+        lua_getglobal(L, "on_reload_restore");
+        if (lua_isfunction(L, -1) && deserialize_value(L, saved.data, saved.size))
+        {
+            if (lua_pcall(L, 1, 0, 0))
+            {
+                printf("Lua error: %s\n", lua_tostring(L, -1));
+                engine->script_active = false;
+            }
+        }
+        lua_settop(L, 0);
+    }
+
+    serial_buffer_free(&saved);
+}
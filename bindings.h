@@ -3,7 +3,24 @@
 
 #include "comet.h"
 
+// object checks and constructors shared with the other binding modules
+Texture2D* cmt_check_image(lua_State* L, int idx, const char* arg_name);
+Color* cmt_check_color(lua_State* L, int idx, const char* arg_name);
+Rectangle* cmt_check_rect(lua_State* L, int idx, const char* arg_name);
+Camera2D* cmt_check_camera(lua_State* L, int idx, const char* arg_name);
+
+Rectangle* cmt_rect_new_internal(lua_State* L, float x, float y, float width, float height);
+Color* cmt_color_new_internal(lua_State* L, int r, int g, int b, int a);
+Camera2D* cmt_camera_new_internal(lua_State* L, float x, float y, float rotation, float zoom);
+
+// swaps new pixels into every image loaded from this path, returns how many were updated
+int image_reload(lua_State* L, const char* file_path);
+
 void initialise_lua(Engine* engine);
 void run_lua_main(Engine* engine);
+void close_lua(Engine* engine);
+
+// closes and reopens the state, carrying over whatever on_reload_save returns
+void restart_lua(Engine* engine);
 
 #endif //BINDINGS_H
@@ -6,10 +6,13 @@
 #include "lualib.h"
 #include "lauxlib.h"
 
+#include "allocator.h"
+
 typedef struct Engine
 {
     lua_State* L;
     bool script_active;
+    Allocator allocator;
 } Engine;
 
 // helpers
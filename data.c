@@ -0,0 +1,680 @@
+#include "data.h"
+#include "pack.h"
+#include "telemetry.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#define JSON_MAX_DEPTH 200
+#define NUMBER_MAX_LENGTH 64
+
+// MARK: Mapped Files
+
+bool data_map_file(const char* file_path, MappedFile* file)
+{
+    file->data = NULL;
+    file->size = 0;
+    file->mapped = false;
+
+#ifndef _WIN32
+    // packed files only exist inside the pack blob, they are read through raylib's callback below
+    const int fd = pack_find(file_path) == NULL ? open(file_path, O_RDONLY) : -1;
+    if (fd >= 0)
+    {
+        struct stat st;
+        if (fstat(fd, &st) != 0)
+        {
+            close(fd);
+            return false;
+        }
+
+        // mapping an empty file is an error, an empty view is not
+        if (st.st_size == 0)
+        {
+            close(fd);
+            file->data = "";
+            return true;
+        }
+
+        void* view = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+
+        if (view != MAP_FAILED)
+        {
+            file->data = view;
+            file->size = (size_t)st.st_size;
+            file->mapped = true;
+            return true;
+        }
+    }
+#endif
+
+    // fall back to reading the whole file
+    int size = 0;
+    unsigned char* data = LoadFileData(file_path, &size);
+    if (data == NULL)
+        return false;
+
+    file->data = (const char*)data;
+    file->size = (size_t)size;
+    return true;
+}
+
+void data_unmap_file(MappedFile* file)
+{
+#ifndef _WIN32
+    if (file->mapped)
+        munmap((void*)file->data, file->size);
+    else
+#endif
+    if (file->size != 0)
+        UnloadFileData((unsigned char*)file->data);
+
+    file->data = NULL;
+    file->size = 0;
+    file->mapped = false;
+}
+
+// MARK: Mapped File Userdata
+
+typedef struct DataReader
+{
+    MappedFile file;
+    size_t position;
+    char separator;
+} DataReader;
+
+static int cmt_data_reader_gc(lua_State* L)
+{
+    DataReader* reader = luaL_checkudata(L, 1, "__mt_data_reader");
+    if (reader->file.data != NULL)
+        data_unmap_file(&reader->file);
+    return 0;
+}
+
+// the reader lives on the Lua stack so the mapping is released by the GC even if parsing raises an error
+static DataReader* cmt_data_reader_new(lua_State* L, const char* file_path, const char* function_name)
+{
+    DataReader* reader = lua_newuserdata(L, sizeof(DataReader));
+    memset(reader, 0, sizeof(DataReader));
+
+    luaL_getmetatable(L, "__mt_data_reader");
+    lua_setmetatable(L, -2);
+
+    if (!data_map_file(file_path, &reader->file))
+        luaL_error(L, "%s failed to load file at \"%s\"", function_name, file_path);
+
+    telemetry_text_loaded(reader->file.size);
+    return reader;
+}
+
+static bool parse_number(const char* str, const size_t length, lua_Number* number)
+{
+    if (length == 0 || length >= NUMBER_MAX_LENGTH)
+        return false;
+
+    // only plain decimal notation, so fields such as "nan" or "inf" stay strings
+    if (str[0] == '\0' || strchr("+-.0123456789", str[0]) == NULL)
+        return false;
+
+    // mapped data is not null terminated, strtod needs a terminated copy
+    char buffer[NUMBER_MAX_LENGTH];
+    memcpy(buffer, str, length);
+    buffer[length] = '\0';
+
+    char* end = NULL;
+    *number = strtod(buffer, &end);
+    return end == buffer + length;
+}
+
+// MARK: Line Iterator
+
+static int cmt_data_lines_next(lua_State* L)
+{
+    DataReader* reader = lua_touserdata(L, lua_upvalueindex(1));
+    const MappedFile* file = &reader->file;
+
+    if (reader->position >= file->size)
+    {
+        // release the mapping as soon as iteration finishes rather than waiting for the GC
+        data_unmap_file(&reader->file);
+        return 0;
+    }
+
+    const char* start = file->data + reader->position;
+    const char* newline = memchr(start, '\n', file->size - reader->position);
+    size_t length = newline != NULL ? (size_t)(newline - start) : file->size - reader->position;
+    reader->position += length + (newline != NULL ? 1 : 0);
+
+    if (length > 0 && start[length - 1] == '\r')
+        length--;
+
+    lua_pushlstring(L, start, length);
+    return 1;
+}
+
+// MARK: CSV Parsing
+
+// pushes the next field, end_of_record is set once the field closes its line
+static void csv_push_field(lua_State* L, DataReader* reader, bool* end_of_record)
+{
+    const char* data = reader->file.data;
+    const size_t size = reader->file.size;
+    size_t i = reader->position;
+
+    if (i < size && data[i] == '"')
+    {
+        // quoted field, "" inside quotes is an escaped quote
+        luaL_Buffer buffer;
+        luaL_buffinit(L, &buffer);
+        i++;
+
+        size_t run_start = i;
+        while (i < size)
+        {
+            if (data[i] == '"')
+            {
+                luaL_addlstring(&buffer, data + run_start, i - run_start);
+                if (i + 1 < size && data[i + 1] == '"')
+                {
+                    luaL_addchar(&buffer, '"');
+                    i += 2;
+                    run_start = i;
+                    continue;
+                }
+
+                i++;
+                run_start = i;
+                break;
+            }
+            i++;
+        }
+
+        if (run_start < i && i >= size)
+            luaL_addlstring(&buffer, data + run_start, i - run_start);
+
+        luaL_pushresult(&buffer);
+
+        // skip anything between the closing quote and the separator
+        while (i < size && data[i] != reader->separator && data[i] != '\n')
+            i++;
+    }
+    else
+    {
+        const size_t start = i;
+        while (i < size && data[i] != reader->separator && data[i] != '\n')
+            i++;
+
+        size_t length = i - start;
+        if (length > 0 && data[start + length - 1] == '\r')
+            length--;
+
+        lua_Number number;
+        if (parse_number(data + start, length, &number))
+            lua_pushnumber(L, number);
+        else
+            lua_pushlstring(L, data + start, length);
+    }
+
+    *end_of_record = i >= size || data[i] == '\n';
+    reader->position = i < size ? i + 1 : size;
+}
+
+// pushes a sequence of fields for the next record, returns false at the end of the file
+static bool csv_push_record(lua_State* L, DataReader* reader)
+{
+    // skip blank lines between records
+    while (reader->position < reader->file.size)
+    {
+        const char c = reader->file.data[reader->position];
+        if (c != '\n' && c != '\r')
+            break;
+        reader->position++;
+    }
+
+    if (reader->position >= reader->file.size)
+        return false;
+
+    lua_newtable(L);
+    bool end_of_record = false;
+    int index = 1;
+    while (!end_of_record)
+    {
+        csv_push_field(L, reader, &end_of_record);
+        lua_rawseti(L, -2, index++);
+    }
+
+    return true;
+}
+
+static int cmt_data_records_next(lua_State* L)
+{
+    DataReader* reader = lua_touserdata(L, lua_upvalueindex(1));
+    if (csv_push_record(L, reader))
+        return 1;
+
+    data_unmap_file(&reader->file);
+    return 0;
+}
+
+// MARK: JSON Parsing
+
+typedef struct JsonParser
+{
+    lua_State* L;
+    const char* start;
+    const char* cur;
+    const char* end;
+    const char* file_path;
+    int depth;
+} JsonParser;
+
+static void json_error(const JsonParser* parser, const char* message)
+{
+    int line = 1;
+    for (const char* c = parser->start; c < parser->cur; ++c)
+    {
+        if (*c == '\n')
+            line++;
+    }
+
+    luaL_error(parser->L, "data_load_json failed to parse \"%s\": %s on line %d", parser->file_path, message, line);
+}
+
+static void json_skip_whitespace(JsonParser* parser)
+{
+    while (parser->cur < parser->end)
+    {
+        const char c = *parser->cur;
+        if (c != ' ' && c != '\t' && c != '\n' && c != '\r')
+            break;
+        parser->cur++;
+    }
+}
+
+static bool json_match(JsonParser* parser, const char* literal)
+{
+    const size_t length = strlen(literal);
+    if ((size_t)(parser->end - parser->cur) < length || memcmp(parser->cur, literal, length) != 0)
+        return false;
+
+    parser->cur += length;
+    return true;
+}
+
+static unsigned int json_read_hex(JsonParser* parser)
+{
+    if (parser->end - parser->cur < 4)
+        json_error(parser, "truncated unicode escape");
+
+    unsigned int value = 0;
+    for (int i = 0; i < 4; ++i)
+    {
+        const char c = *parser->cur++;
+        value <<= 4;
+        if (c >= '0' && c <= '9')
+            value |= c - '0';
+        else if (c >= 'a' && c <= 'f')
+            value |= c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F')
+            value |= c - 'A' + 10;
+        else
+            json_error(parser, "invalid unicode escape");
+    }
+    return value;
+}
+
+static void json_add_utf8(luaL_Buffer* buffer, const unsigned int codepoint)
+{
+    if (codepoint < 0x80)
+    {
+        luaL_addchar(buffer, (char)codepoint);
+    }
+    else if (codepoint < 0x800)
+    {
+        luaL_addchar(buffer, (char)(0xC0 | (codepoint >> 6)));
+        luaL_addchar(buffer, (char)(0x80 | (codepoint & 0x3F)));
+    }
+    else if (codepoint < 0x10000)
+    {
+        luaL_addchar(buffer, (char)(0xE0 | (codepoint >> 12)));
+        luaL_addchar(buffer, (char)(0x80 | ((codepoint >> 6) & 0x3F)));
+        luaL_addchar(buffer, (char)(0x80 | (codepoint & 0x3F)));
+    }
+    else
+    {
+        luaL_addchar(buffer, (char)(0xF0 | (codepoint >> 18)));
+        luaL_addchar(buffer, (char)(0x80 | ((codepoint >> 12) & 0x3F)));
+        luaL_addchar(buffer, (char)(0x80 | ((codepoint >> 6) & 0x3F)));
+        luaL_addchar(buffer, (char)(0x80 | (codepoint & 0x3F)));
+    }
+}
+
+static void json_push_string(JsonParser* parser)
+{
+    // skip the opening quote
+    parser->cur++;
+    const char* start = parser->cur;
+
+    // fast path, strings without escapes are pushed straight from the mapped buffer
+    while (parser->cur < parser->end && *parser->cur != '"' && *parser->cur != '\\')
+        parser->cur++;
+
+    if (parser->cur >= parser->end)
+        json_error(parser, "unterminated string");
+
+    if (*parser->cur == '"')
+    {
+        lua_pushlstring(parser->L, start, parser->cur - start);
+        parser->cur++;
+        return;
+    }
+
+    luaL_Buffer buffer;
+    luaL_buffinit(parser->L, &buffer);
+    luaL_addlstring(&buffer, start, parser->cur - start);
+
+    while (parser->cur < parser->end && *parser->cur != '"')
+    {
+        const char c = *parser->cur++;
+        if (c != '\\')
+        {
+            luaL_addchar(&buffer, c);
+            continue;
+        }
+
+        if (parser->cur >= parser->end)
+            break;
+
+        const char escape = *parser->cur++;
+        switch (escape)
+        {
+        case '"': luaL_addchar(&buffer, '"'); break;
+        case '\\': luaL_addchar(&buffer, '\\'); break;
+        case '/': luaL_addchar(&buffer, '/'); break;
+        case 'b': luaL_addchar(&buffer, '\b'); break;
+        case 'f': luaL_addchar(&buffer, '\f'); break;
+        case 'n': luaL_addchar(&buffer, '\n'); break;
+        case 'r': luaL_addchar(&buffer, '\r'); break;
+        case 't': luaL_addchar(&buffer, '\t'); break;
+        case 'u':
+            {
+                unsigned int codepoint = json_read_hex(parser);
+
+                // combine surrogate pairs into a single codepoint, a half on its own is not valid UTF-8
+                if (codepoint >= 0xD800 && codepoint <= 0xDBFF)
+                {
+                    if (!json_match(parser, "\\u"))
+                        json_error(parser, "invalid surrogate pair");
+
+                    const unsigned int low = json_read_hex(parser);
+                    if (low < 0xDC00 || low > 0xDFFF)
+                        json_error(parser, "invalid surrogate pair");
+
+                    codepoint = 0x10000 + ((codepoint - 0xD800) << 10) + (low - 0xDC00);
+                }
+                else if (codepoint >= 0xDC00 && codepoint <= 0xDFFF)
+                {
+                    json_error(parser, "invalid surrogate pair");
+                }
+
+                json_add_utf8(&buffer, codepoint);
+                break;
+            }
+        default:
+            json_error(parser, "invalid escape sequence");
+        }
+    }
+
+    if (parser->cur >= parser->end)
+        json_error(parser, "unterminated string");
+
+    parser->cur++;
+    luaL_pushresult(&buffer);
+}
+
+static void json_push_value(JsonParser* parser);
+
+static void json_push_array(JsonParser* parser)
+{
+    parser->cur++;
+    lua_newtable(parser->L);
+
+    json_skip_whitespace(parser);
+    if (parser->cur < parser->end && *parser->cur == ']')
+    {
+        parser->cur++;
+        return;
+    }
+
+    int index = 1;
+    while (true)
+    {
+        json_push_value(parser);
+        lua_rawseti(parser->L, -2, index++);
+
+        json_skip_whitespace(parser);
+        if (parser->cur >= parser->end)
+            json_error(parser, "unterminated array");
+
+        const char c = *parser->cur++;
+        if (c == ']')
+            break;
+        if (c != ',')
+            json_error(parser, "expected ',' or ']'");
+    }
+}
+
+static void json_push_object(JsonParser* parser)
+{
+    parser->cur++;
+    lua_newtable(parser->L);
+
+    json_skip_whitespace(parser);
+    if (parser->cur < parser->end && *parser->cur == '}')
+    {
+        parser->cur++;
+        return;
+    }
+
+    while (true)
+    {
+        json_skip_whitespace(parser);
+        if (parser->cur >= parser->end || *parser->cur != '"')
+            json_error(parser, "expected string key");
+
+        json_push_string(parser);
+
+        json_skip_whitespace(parser);
+        if (parser->cur >= parser->end || *parser->cur != ':')
+            json_error(parser, "expected ':'");
+        parser->cur++;
+
+        json_push_value(parser);
+        lua_rawset(parser->L, -3);
+
+        json_skip_whitespace(parser);
+        if (parser->cur >= parser->end)
+            json_error(parser, "unterminated object");
+
+        const char c = *parser->cur++;
+        if (c == '}')
+            break;
+        if (c != ',')
+            json_error(parser, "expected ',' or '}'");
+    }
+}
+
+static void json_push_value(JsonParser* parser)
+{
+    if (++parser->depth > JSON_MAX_DEPTH)
+        json_error(parser, "nesting too deep");
+
+    luaL_checkstack(parser->L, 3, "data_load_json nesting too deep");
+    json_skip_whitespace(parser);
+
+    if (parser->cur >= parser->end)
+        json_error(parser, "unexpected end of file");
+
+    const char c = *parser->cur;
+    if (c == '{')
+    {
+        json_push_object(parser);
+    }
+    else if (c == '[')
+    {
+        json_push_array(parser);
+    }
+    else if (c == '"')
+    {
+        json_push_string(parser);
+    }
+    else if (json_match(parser, "true"))
+    {
+        lua_pushboolean(parser->L, true);
+    }
+    else if (json_match(parser, "false"))
+    {
+        lua_pushboolean(parser->L, false);
+    }
+    else if (json_match(parser, "null"))
+    {
+        // null has no Lua equivalent that survives table storage, it becomes nil
+        lua_pushnil(parser->L);
+    }
+    else
+    {
+        const char* start = parser->cur;
+        while (parser->cur < parser->end && *parser->cur != '\0' && strchr("+-0123456789.eE", *parser->cur) != NULL)
+            parser->cur++;
+
+        lua_Number number;
+        if (!parse_number(start, parser->cur - start, &number))
+            json_error(parser, "invalid value");
+
+        lua_pushnumber(parser->L, number);
+    }
+
+    parser->depth--;
+}
+
+// MARK: Lua Functions
+
+static int cmt_data_load_text(lua_State* L)
+{
+    const char* file_path = luaL_checkstring(L, 1);
+    DataReader* reader = cmt_data_reader_new(L, file_path, "data_load_text");
+
+    // the only copy is the one into the Lua string
+    lua_pushlstring(L, reader->file.data, reader->file.size);
+    data_unmap_file(&reader->file);
+    return 1;
+}
+
+static int cmt_data_lines(lua_State* L)
+{
+    const char* file_path = luaL_checkstring(L, 1);
+    cmt_data_reader_new(L, file_path, "data_lines");
+    lua_pushcclosure(L, cmt_data_lines_next, 1);
+    return 1;
+}
+
+static int cmt_data_records(lua_State* L)
+{
+    const char* file_path = luaL_checkstring(L, 1);
+    const char* separator = luaL_optstring(L, 2, ",");
+
+    DataReader* reader = cmt_data_reader_new(L, file_path, "data_records");
+    reader->separator = separator[0];
+    lua_pushcclosure(L, cmt_data_records_next, 1);
+    return 1;
+}
+
+static int cmt_data_load_csv(lua_State* L)
+{
+    const char* file_path = luaL_checkstring(L, 1);
+    const bool header = lua_toboolean(L, 2);
+    const char* separator = luaL_optstring(L, 3, ",");
+
+    DataReader* reader = cmt_data_reader_new(L, file_path, "data_load_csv");
+    reader->separator = separator[0];
+    const int reader_idx = lua_gettop(L);
+
+    // with a header row each record is keyed by column name instead of index
+    int header_idx = 0;
+    if (header && csv_push_record(L, reader))
+        header_idx = lua_gettop(L);
+
+    lua_newtable(L);
+    const int rows_idx = lua_gettop(L);
+
+    int row = 1;
+    while (csv_push_record(L, reader))
+    {
+        if (header_idx != 0)
+        {
+            const int fields = (int)lua_objlen(L, -1);
+            lua_createtable(L, 0, fields);
+            for (int i = 1; i <= fields; ++i)
+            {
+                lua_rawgeti(L, header_idx, i);
+                if (lua_isnil(L, -1))
+                {
+                    lua_pop(L, 1);
+                    continue;
+                }
+
+                lua_rawgeti(L, -3, i);
+                lua_rawset(L, -3);
+            }
+            lua_remove(L, -2);
+        }
+
+        lua_rawseti(L, rows_idx, row++);
+    }
+
+    data_unmap_file(&reader->file);
+
+    lua_replace(L, reader_idx);
+    lua_settop(L, reader_idx);
+    return 1;
+}
+
+static int cmt_data_load_json(lua_State* L)
+{
+    const char* file_path = luaL_checkstring(L, 1);
+    DataReader* reader = cmt_data_reader_new(L, file_path, "data_load_json");
+
+    JsonParser parser = {L, reader->file.data, reader->file.data, reader->file.data + reader->file.size, file_path, 0};
+    json_push_value(&parser);
+
+    json_skip_whitespace(&parser);
+    if (parser.cur != parser.end)
+        json_error(&parser, "unexpected trailing characters");
+
+    data_unmap_file(&reader->file);
+    return 1;
+}
+
+void register_data_bindings(lua_State* L)
+{
+    lua_register(L, "data_load_text", cmt_data_load_text);
+    lua_register(L, "data_lines", cmt_data_lines);
+    lua_register(L, "data_records", cmt_data_records);
+    lua_register(L, "data_load_csv", cmt_data_load_csv);
+    lua_register(L, "data_load_json", cmt_data_load_json);
+
+    if (!luaL_newmetatable(L, "__mt_data_reader"))
+        printf("Lua error: Data reader metatable at __mt_data_reader already exists\n");
+
+    lua_pushcfunction(L, cmt_data_reader_gc);
+    lua_setfield(L, -2, "__gc");
+    lua_pop(L, 1);
+}
@@ -0,0 +1,19 @@
+#ifndef DATA_H
+#define DATA_H
+
+#include "comet.h"
+
+// read-only view of a whole file, memory mapped where the platform allows it
+typedef struct MappedFile
+{
+    const char* data;
+    size_t size;
+    bool mapped;
+} MappedFile;
+
+bool data_map_file(const char* file_path, MappedFile* file);
+void data_unmap_file(MappedFile* file);
+
+void register_data_bindings(lua_State* L);
+
+#endif //DATA_H
@@ -4,6 +4,8 @@
 #include "util/b64.h"
 
 #include "bindings.h"
+#include "pack.h"
+#include "profiler.h"
 
 static int remove_callback(const char *file_path, const struct stat *sb, int type_flag, struct FTW *ftw_buffer)
 {
@@ -41,21 +43,36 @@ static EM_BOOL test_socket_message(int eventType, const EmscriptenWebSocketMessa
 
         // restart the lua VM upon receiving this message
         if (strcmp(str, "restart_lua") == 0)
+        {
+            Engine* engine = userData;
+            restart_lua(engine);
+            return EM_TRUE;
+        }
+
+        // toggle the sampling profiler, stopping prints the folded stacks to the console
+        if (strcmp(str, "profiler_start") == 0)
+        {
+            Engine* engine = userData;
+            if (engine->L != NULL)
+                profiler_start(engine->L, PROFILER_DEFAULT_INTERVAL);
+            return EM_TRUE;
+        }
+
+        if (strcmp(str, "profiler_stop") == 0)
         {
             Engine* engine = userData;
             if (engine->L != NULL)
             {
-                lua_close(engine->L);
-                engine->L = NULL;
+                profiler_stop(engine->L);
+                profiler_write(stdout);
             }
-            initialise_lua(engine);
-            run_lua_main(engine);
             return EM_TRUE;
         }
 
-        // expected format for string is "<event_kind>,<file_path>,<contents>,<contents_length>,<text_or_binary>"
+        // expected format for string is "<event_kind>,<file_path>,<contents>,<contents_length>,<text_or_binary>[,<codec>]"
         // event_kind of type "remove" only provides "<event_kind>,<file_path>", need to check the rest for NULL
-        // contents_length is ignored for text files, but it's still required for the hacky parser below
+        // contents_length is ignored for uncompressed text files, but it's still required for the hacky parser below
+        // codec is optional, when it is "lz4" the contents are compressed and contents_length is the original size
         const char* event_kind = strtok(str, ",");
         const char* file_path = strtok(NULL, ",");
 
@@ -81,6 +98,7 @@ static EM_BOOL test_socket_message(int eventType, const EmscriptenWebSocketMessa
         const char* contents = strtok(NULL, ",");
         const char* contents_length = strtok(NULL, ",");
         const char* text_or_binary = strtok(NULL, ",");
+        const char* codec_name = strtok(NULL, ",");
         if (contents == NULL || contents_length == NULL || text_or_binary == NULL)
         {
             printf("Received invalid message data format\n");
@@ -93,7 +111,29 @@ static EM_BOOL test_socket_message(int eventType, const EmscriptenWebSocketMessa
         strncpy(dir_name, file_path, position);
         MakeDirectory(dir_name);
 
-        char* decoded = (char*)b64_decode(contents, strlen(contents));
+        size_t decoded_size = 0;
+        char* decoded = (char*)b64_decode_ex(contents, strlen(contents), &decoded_size);
+
+        // compressed payloads are expanded straight into the buffer that gets saved
+        if (codec_name != NULL && strcmp(codec_name, "raw") != 0)
+        {
+            const PackCodec codec = pack_codec_from_name(codec_name);
+            const size_t raw_size = strtoul(contents_length, NULL, 0);
+            char* raw = malloc(raw_size + 1);
+
+            if (codec == PACK_CODEC_COUNT || raw == NULL ||
+                !pack_decode(codec, (unsigned char*)decoded, decoded_size, (unsigned char*)raw, raw_size))
+            {
+                printf("Could not decode \"%s\" payload for \"%s\"\n", codec_name, file_path);
+                free(raw);
+                free(decoded);
+                return EM_FALSE;
+            }
+
+            raw[raw_size] = '\0';
+            free(decoded);
+            decoded = raw;
+        }
 
         if (text_or_binary[0] == '0')
         {
@@ -109,6 +149,14 @@ static EM_BOOL test_socket_message(int eventType, const EmscriptenWebSocketMessa
             {
                 printf("Could not save binary file \"%s\"\n", file_path);
             }
+            else
+            {
+                // images already loaded by the script pick up the new pixels without restarting Lua
+                Engine* engine = userData;
+                const int reloaded = image_reload(engine->L, file_path);
+                if (reloaded > 0)
+                    printf("Reloaded %d image(s) from \"%s\"\n", reloaded, file_path);
+            }
         }
         else
         {
@@ -0,0 +1,637 @@
+#include "entity.h"
+#include "bindings.h"
+#include "jobs.h"
+#include "telemetry.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define GENERATION_MASK ((1u << (32 - ENTITY_INDEX_BITS)) - 1)
+
+EntityStore entity_store = {0};
+
+// how many owners each image registry reference has, the entity using it and every snapshot that saved it
+static int* image_holds = NULL;
+static int image_hold_capacity = 0;
+
+// MARK: Store Management
+
+static void grow_dense(EntityStore* store)
+{
+    store->capacity = store->capacity == 0 ? 256 : store->capacity * 2;
+    const size_t n = (size_t)store->capacity;
+
+    store->x = realloc(store->x, sizeof(float) * n);
+    store->y = realloc(store->y, sizeof(float) * n);
+    store->vx = realloc(store->vx, sizeof(float) * n);
+    store->vy = realloc(store->vy, sizeof(float) * n);
+    store->width = realloc(store->width, sizeof(float) * n);
+    store->height = realloc(store->height, sizeof(float) * n);
+    store->flags = realloc(store->flags, sizeof(unsigned char) * n);
+    store->image = realloc(store->image, sizeof(Texture2D*) * n);
+    store->region = realloc(store->region, sizeof(Rectangle) * n);
+    store->image_ref = realloc(store->image_ref, sizeof(int) * n);
+    store->handle = realloc(store->handle, sizeof(EntityHandle) * n);
+}
+
+static void grow_slots(EntityStore* store)
+{
+    store->slot_capacity = store->slot_capacity == 0 ? 256 : store->slot_capacity * 2;
+    store->sparse = realloc(store->sparse, sizeof(int) * store->slot_capacity);
+    store->generation = realloc(store->generation, sizeof(uint16_t) * store->slot_capacity);
+    store->free_slots = realloc(store->free_slots, sizeof(int) * store->slot_capacity);
+}
+
+static int acquire_slot(EntityStore* store)
+{
+    if (store->free_count > 0)
+        return store->free_slots[--store->free_count];
+
+    if (store->slot_count == store->slot_capacity)
+        grow_slots(store);
+
+    store->generation[store->slot_count] = 0;
+    return store->slot_count++;
+}
+
+static EntityHandle entity_create(EntityStore* store, const float x, const float y, const float width,
+                                  const float height)
+{
+    if (store->count == store->capacity)
+        grow_dense(store);
+
+    const int slot = acquire_slot(store);
+    const int i = store->count++;
+    const EntityHandle handle = ((EntityHandle)store->generation[slot] << ENTITY_INDEX_BITS) | (EntityHandle)slot;
+
+    store->sparse[slot] = i;
+    store->x[i] = x;
+    store->y[i] = y;
+    store->vx[i] = 0;
+    store->vy[i] = 0;
+    store->width[i] = width;
+    store->height[i] = height;
+    store->flags[i] = ENTITY_VISIBLE;
+    store->image[i] = NULL;
+    store->region[i] = (Rectangle){0, 0, 0, 0};
+    store->image_ref[i] = LUA_NOREF;
+    store->handle[i] = handle;
+
+    return handle;
+}
+
+static void hold_image(const int ref)
+{
+    if (ref < 0)
+        return;
+
+    if (ref >= image_hold_capacity)
+    {
+        const int capacity = image_hold_capacity == 0 ? 256 : image_hold_capacity;
+        int new_capacity = capacity;
+        while (ref >= new_capacity)
+            new_capacity *= 2;
+
+        image_holds = realloc(image_holds, sizeof(int) * new_capacity);
+        memset(image_holds + image_hold_capacity, 0, sizeof(int) * (new_capacity - image_hold_capacity));
+        image_hold_capacity = new_capacity;
+    }
+
+    image_holds[ref]++;
+}
+
+// the reference is only given back to the registry once nothing holds it anymore
+static void release_image(lua_State* L, const int ref)
+{
+    if (ref < 0 || ref >= image_hold_capacity || image_holds[ref] == 0)
+        return;
+
+    if (--image_holds[ref] == 0)
+        luaL_unref(L, LUA_REGISTRYINDEX, ref);
+}
+
+static void entity_destroy(lua_State* L, EntityStore* store, const int i)
+{
+    const int slot = (int)(store->handle[i] & ENTITY_INDEX_MASK);
+    release_image(L, store->image_ref[i]);
+
+    // move the last entity into the hole to keep the arrays dense
+    const int last = --store->count;
+    if (i != last)
+    {
+        store->x[i] = store->x[last];
+        store->y[i] = store->y[last];
+        store->vx[i] = store->vx[last];
+        store->vy[i] = store->vy[last];
+        store->width[i] = store->width[last];
+        store->height[i] = store->height[last];
+        store->flags[i] = store->flags[last];
+        store->image[i] = store->image[last];
+        store->region[i] = store->region[last];
+        store->image_ref[i] = store->image_ref[last];
+        store->handle[i] = store->handle[last];
+        store->sparse[store->handle[i] & ENTITY_INDEX_MASK] = i;
+    }
+
+    // bumping the generation invalidates every handle still pointing at the slot
+    store->generation[slot] = (uint16_t)((store->generation[slot] + 1) & GENERATION_MASK);
+    store->sparse[slot] = -1;
+    store->free_slots[store->free_count++] = slot;
+}
+
+int entity_lookup(const EntityHandle handle)
+{
+    const EntityStore* store = &entity_store;
+    const int slot = (int)(handle & ENTITY_INDEX_MASK);
+    if (slot >= store->slot_count || store->generation[slot] != handle >> ENTITY_INDEX_BITS)
+        return -1;
+    return store->sparse[slot];
+}
+
+void entity_reset(void)
+{
+    EntityStore* store = &entity_store;
+    free(store->x);
+    free(store->y);
+    free(store->vx);
+    free(store->vy);
+    free(store->width);
+    free(store->height);
+    free(store->flags);
+    free(store->image);
+    free(store->region);
+    free(store->image_ref);
+    free(store->handle);
+    free(store->sparse);
+    free(store->generation);
+    free(store->free_slots);
+    memset(store, 0, sizeof(EntityStore));
+
+    free(image_holds);
+    image_holds = NULL;
+    image_hold_capacity = 0;
+}
+
+// MARK: Snapshots
+
+void entity_snapshot_save(SerialBuffer* buffer, SerialBuffer* images)
+{
+    const EntityStore* store = &entity_store;
+    const int header[3] = {store->count, store->slot_count, store->free_count};
+    const size_t n = (size_t)store->count;
+
+    serial_buffer_write(buffer, header, sizeof(header));
+    serial_buffer_write(buffer, store->x, sizeof(float) * n);
+    serial_buffer_write(buffer, store->y, sizeof(float) * n);
+    serial_buffer_write(buffer, store->vx, sizeof(float) * n);
+    serial_buffer_write(buffer, store->vy, sizeof(float) * n);
+    serial_buffer_write(buffer, store->width, sizeof(float) * n);
+    serial_buffer_write(buffer, store->height, sizeof(float) * n);
+    serial_buffer_write(buffer, store->flags, sizeof(unsigned char) * n);
+    serial_buffer_write(buffer, store->region, sizeof(Rectangle) * n);
+    serial_buffer_write(buffer, store->image_ref, sizeof(int) * n);
+    serial_buffer_write(buffer, store->handle, sizeof(EntityHandle) * n);
+    serial_buffer_write(buffer, store->sparse, sizeof(int) * store->slot_count);
+    serial_buffer_write(buffer, store->generation, sizeof(uint16_t) * store->slot_count);
+    serial_buffer_write(buffer, store->free_slots, sizeof(int) * store->free_count);
+
+    // every entity has its own reference, so each one is held once per snapshot
+    serial_buffer_clear(images);
+    for (int i = 0; i < store->count; ++i)
+    {
+        const int ref = store->image_ref[i];
+        if (ref >= 0)
+        {
+            hold_image(ref);
+            serial_buffer_write(images, &ref, sizeof(ref));
+        }
+    }
+}
+
+void entity_snapshot_release(lua_State* L, SerialBuffer* images)
+{
+    const size_t count = images->size / sizeof(int);
+    for (size_t i = 0; i < count; ++i)
+    {
+        int ref;
+        memcpy(&ref, images->data + sizeof(int) * i, sizeof(ref));
+        release_image(L, ref);
+    }
+    serial_buffer_clear(images);
+}
+
+static const unsigned char* read_array(void* out, const unsigned char* data, const size_t size)
+{
+    memcpy(out, data, size);
+    return data + size;
+}
+
+bool entity_snapshot_restore(lua_State* L, const unsigned char* data, const size_t size)
+{
+    EntityStore* store = &entity_store;
+    int header[3];
+    if (size < sizeof(header))
+        return false;
+
+    memcpy(header, data, sizeof(header));
+    const int count = header[0];
+    const int slot_count = header[1];
+    const int free_count = header[2];
+
+    const size_t per_entity = sizeof(float) * 6 + sizeof(unsigned char) + sizeof(Rectangle) + sizeof(int) + sizeof(EntityHandle);
+    const size_t per_slot = sizeof(int) + sizeof(uint16_t);
+    if (count < 0 || slot_count < 0 || free_count < 0 || count > slot_count || free_count > slot_count ||
+        size != sizeof(header) + per_entity * count + per_slot * slot_count + sizeof(int) * free_count)
+        return false;
+
+    // the snapshot holds every image it saved, so the restored references are alive even when their entities are not
+    const unsigned char* refs = data + sizeof(header) + (sizeof(float) * 6 + sizeof(unsigned char) + sizeof(Rectangle)) * count;
+    for (int i = 0; i < count; ++i)
+    {
+        int ref;
+        memcpy(&ref, refs + sizeof(int) * i, sizeof(ref));
+        hold_image(ref);
+    }
+    for (int i = 0; i < store->count; ++i)
+        release_image(L, store->image_ref[i]);
+
+    while (store->capacity < count)
+        grow_dense(store);
+    while (store->slot_capacity < slot_count)
+        grow_slots(store);
+
+    const size_t n = (size_t)count;
+    const unsigned char* cur = data + sizeof(header);
+    cur = read_array(store->x, cur, sizeof(float) * n);
+    cur = read_array(store->y, cur, sizeof(float) * n);
+    cur = read_array(store->vx, cur, sizeof(float) * n);
+    cur = read_array(store->vy, cur, sizeof(float) * n);
+    cur = read_array(store->width, cur, sizeof(float) * n);
+    cur = read_array(store->height, cur, sizeof(float) * n);
+    cur = read_array(store->flags, cur, sizeof(unsigned char) * n);
+    cur = read_array(store->region, cur, sizeof(Rectangle) * n);
+    cur = read_array(store->image_ref, cur, sizeof(int) * n);
+    cur = read_array(store->handle, cur, sizeof(EntityHandle) * n);
+    cur = read_array(store->sparse, cur, sizeof(int) * slot_count);
+    cur = read_array(store->generation, cur, sizeof(uint16_t) * slot_count);
+    read_array(store->free_slots, cur, sizeof(int) * free_count);
+
+    store->count = count;
+    store->slot_count = slot_count;
+    store->free_count = free_count;
+
+    // the image userdata is the texture itself, entities sharing one usually sit next to each other
+    int last_ref = LUA_NOREF;
+    const Texture2D* last_image = NULL;
+    for (int i = 0; i < count; ++i)
+    {
+        const int ref = store->image_ref[i];
+        if (ref < 0)
+        {
+            store->image[i] = NULL;
+            continue;
+        }
+
+        if (ref != last_ref)
+        {
+            lua_rawgeti(L, LUA_REGISTRYINDEX, ref);
+            last_image = lua_touserdata(L, -1);
+            lua_pop(L, 1);
+            last_ref = ref;
+        }
+        store->image[i] = last_image;
+    }
+
+    return true;
+}
+
+// MARK: Systems
+
+// entities are independent, so the movement and culling passes are split across the job threads
+#define ENTITY_BATCH_SIZE 4096
+
+static void move_range(void* data, const int start, const int end)
+{
+    const float dt = *(const float*)data;
+    EntityStore* store = &entity_store;
+    float* x = store->x;
+    float* y = store->y;
+    const float* vx = store->vx;
+    const float* vy = store->vy;
+
+    for (int i = start; i < end; ++i)
+    {
+        x[i] += vx[i] * dt;
+        y[i] += vy[i] * dt;
+    }
+}
+
+void entity_update(float dt)
+{
+    jobs_parallel_for(entity_store.count, ENTITY_BATCH_SIZE, move_range, &dt);
+}
+
+static void cull_range(void* data, const int start, const int end)
+{
+    const Rectangle view = *(const Rectangle*)data;
+    EntityStore* store = &entity_store;
+    const float right = view.x + view.width;
+    const float bottom = view.y + view.height;
+
+    for (int i = start; i < end; ++i)
+    {
+        const bool in_view = store->x[i] < right && store->x[i] + store->width[i] > view.x &&
+                             store->y[i] < bottom && store->y[i] + store->height[i] > view.y;
+
+        if (in_view)
+            store->flags[i] |= ENTITY_IN_VIEW;
+        else
+            store->flags[i] &= ~ENTITY_IN_VIEW;
+    }
+}
+
+static void entity_cull(Rectangle view)
+{
+    jobs_parallel_for(entity_store.count, ENTITY_BATCH_SIZE, cull_range, &view);
+}
+
+static int entity_draw(void)
+{
+    const EntityStore* store = &entity_store;
+    const unsigned char mask = ENTITY_VISIBLE | ENTITY_HAS_SPRITE | ENTITY_IN_VIEW;
+    int drawn = 0;
+
+    for (int i = 0; i < store->count; ++i)
+    {
+        if ((store->flags[i] & mask) != mask)
+            continue;
+
+        const Rectangle dest = {store->x[i], store->y[i], store->width[i], store->height[i]};
+        DrawTexturePro(*store->image[i], store->region[i], dest, (Vector2){0, 0}, 0, WHITE);
+        drawn++;
+    }
+
+    return drawn;
+}
+
+// world space area covered by the screen under a camera
+static Rectangle camera_view(const Camera2D* cam)
+{
+    const float width = (float)GetScreenWidth();
+    const float height = (float)GetScreenHeight();
+    const Vector2 corners[4] = {
+        GetScreenToWorld2D((Vector2){0, 0}, *cam),
+        GetScreenToWorld2D((Vector2){width, 0}, *cam),
+        GetScreenToWorld2D((Vector2){0, height}, *cam),
+        GetScreenToWorld2D((Vector2){width, height}, *cam)
+    };
+
+    Vector2 min = corners[0];
+    Vector2 max = corners[0];
+    for (int i = 1; i < 4; ++i)
+    {
+        min.x = fminf(min.x, corners[i].x);
+        min.y = fminf(min.y, corners[i].y);
+        max.x = fmaxf(max.x, corners[i].x);
+        max.y = fmaxf(max.y, corners[i].y);
+    }
+
+    return (Rectangle){min.x, min.y, max.x - min.x, max.y - min.y};
+}
+
+// MARK: Entity Functions
+
+void entity_push_handle(lua_State* L, const EntityHandle handle)
+{
+    // the view is only a handle, dropping it does not destroy the entity
+    EntityHandle* view = lua_newuserdata(L, sizeof(EntityHandle));
+    *view = handle;
+
+    luaL_getmetatable(L, "__mt_entity");
+    lua_setmetatable(L, -2);
+
+    telemetry_userdata_created(TELEMETRY_ENTITY);
+}
+
+static EntityHandle* cmt_check_entity_handle(lua_State* L, const int idx)
+{
+    return luaL_checkudata(L, idx, "__mt_entity");
+}
+
+// dense index of a live entity view, raises an error for destroyed entities
+static int cmt_check_entity(lua_State* L, const int idx)
+{
+    const EntityHandle* handle = cmt_check_entity_handle(L, idx);
+    const int i = entity_lookup(*handle);
+    if (i == -1)
+        luaL_error(L, "Entity is no longer alive.");
+    return i;
+}
+
+static int cmt_entity_new(lua_State* L)
+{
+    const float x = (float)luaL_optnumber(L, 1, 0);
+    const float y = (float)luaL_optnumber(L, 2, 0);
+    const float width = (float)luaL_optnumber(L, 3, 0);
+    const float height = (float)luaL_optnumber(L, 4, 0);
+
+    if (entity_store.free_count == 0 && entity_store.slot_count == ENTITY_MAX_COUNT)
+        return luaL_error(L, "entity_new failed, the entity store is full");
+
+    entity_push_handle(L, entity_create(&entity_store, x, y, width, height));
+    return 1;
+}
+
+static int cmt_entity_destroy(lua_State* L)
+{
+    const EntityHandle* handle = cmt_check_entity_handle(L, 1);
+    const int i = entity_lookup(*handle);
+    if (i != -1)
+        entity_destroy(L, &entity_store, i);
+    return 0;
+}
+
+static int cmt_entity_set_sprite(lua_State* L)
+{
+    const int i = cmt_check_entity(L, 1);
+    EntityStore* store = &entity_store;
+
+    release_image(L, store->image_ref[i]);
+    store->image_ref[i] = LUA_NOREF;
+
+    if (lua_isnoneornil(L, 2))
+    {
+        store->image[i] = NULL;
+        store->flags[i] &= ~ENTITY_HAS_SPRITE;
+        return 0;
+    }
+
+    const Texture2D* image = cmt_check_image(L, 2, "image");
+    const Rectangle region = lua_isnoneornil(L, 3)
+                                 ? (Rectangle){0, 0, (float)image->width, (float)image->height}
+                                 : *cmt_check_rect(L, 3, "region");
+
+    // the registry reference keeps the image alive for as long as the entity uses it
+    lua_pushvalue(L, 2);
+    store->image_ref[i] = luaL_ref(L, LUA_REGISTRYINDEX);
+    hold_image(store->image_ref[i]);
+    store->image[i] = image;
+    store->region[i] = region;
+    store->flags[i] |= ENTITY_HAS_SPRITE;
+
+    // entities without a size take the size of their sprite
+    if (store->width[i] == 0 && store->height[i] == 0)
+    {
+        store->width[i] = fabsf(region.width);
+        store->height[i] = fabsf(region.height);
+    }
+
+    return 0;
+}
+
+static int cmt_entities_draw(lua_State* L)
+{
+    // without a camera the view is the screen itself
+    Rectangle view = {0, 0, (float)GetScreenWidth(), (float)GetScreenHeight()};
+    if (!lua_isnoneornil(L, 1))
+        view = camera_view(cmt_check_camera(L, 1, "camera"));
+
+    entity_cull(view);
+    lua_pushinteger(L, entity_draw());
+    return 1;
+}
+
+static int cmt_entity_count(lua_State* L)
+{
+    lua_pushinteger(L, entity_store.count);
+    return 1;
+}
+
+static int cmt_entity_index(lua_State* L)
+{
+    const EntityHandle* handle = cmt_check_entity_handle(L, 1);
+    const char* key = luaL_checkstring(L, 2);
+    const int i = entity_lookup(*handle);
+
+    if (strcmp(key, "alive") == 0)
+    {
+        lua_pushboolean(L, i != -1);
+        return 1;
+    }
+
+    if (i == -1)
+        return luaL_error(L, "Entity is no longer alive.");
+
+    const EntityStore* store = &entity_store;
+    if (strcmp(key, "x") == 0)
+    {
+        lua_pushnumber(L, store->x[i]);
+    }
+    else if (strcmp(key, "y") == 0)
+    {
+        lua_pushnumber(L, store->y[i]);
+    }
+    else if (strcmp(key, "vx") == 0)
+    {
+        lua_pushnumber(L, store->vx[i]);
+    }
+    else if (strcmp(key, "vy") == 0)
+    {
+        lua_pushnumber(L, store->vy[i]);
+    }
+    else if (strcmp(key, "width") == 0)
+    {
+        lua_pushnumber(L, store->width[i]);
+    }
+    else if (strcmp(key, "height") == 0)
+    {
+        lua_pushnumber(L, store->height[i]);
+    }
+    else if (strcmp(key, "visible") == 0)
+    {
+        lua_pushboolean(L, (store->flags[i] & ENTITY_VISIBLE) != 0);
+    }
+    else if (strcmp(key, "in_view") == 0)
+    {
+        lua_pushboolean(L, (store->flags[i] & ENTITY_IN_VIEW) != 0);
+    }
+    else
+    {
+        return luaL_error(L, "Entity has no field \"%s\".", key);
+    }
+
+    return 1;
+}
+
+static int cmt_entity_newindex(lua_State* L)
+{
+    const int i = cmt_check_entity(L, 1);
+    const char* key = luaL_checkstring(L, 2);
+    EntityStore* store = &entity_store;
+
+    if (strcmp(key, "x") == 0)
+    {
+        store->x[i] = (float)luaL_checknumber(L, 3);
+    }
+    else if (strcmp(key, "y") == 0)
+    {
+        store->y[i] = (float)luaL_checknumber(L, 3);
+    }
+    else if (strcmp(key, "vx") == 0)
+    {
+        store->vx[i] = (float)luaL_checknumber(L, 3);
+    }
+    else if (strcmp(key, "vy") == 0)
+    {
+        store->vy[i] = (float)luaL_checknumber(L, 3);
+    }
+    else if (strcmp(key, "width") == 0)
+    {
+        store->width[i] = (float)luaL_checknumber(L, 3);
+    }
+    else if (strcmp(key, "height") == 0)
+    {
+        store->height[i] = (float)luaL_checknumber(L, 3);
+    }
+    else if (strcmp(key, "visible") == 0)
+    {
+        if (lua_toboolean(L, 3))
+            store->flags[i] |= ENTITY_VISIBLE;
+        else
+            store->flags[i] &= ~ENTITY_VISIBLE;
+    }
+    else
+    {
+        return luaL_error(L, "Entity has no writable field \"%s\".", key);
+    }
+
+    return 0;
+}
+
+static int cmt_entity_eq(lua_State* L)
+{
+    const EntityHandle* a = cmt_check_entity_handle(L, 1);
+    const EntityHandle* b = cmt_check_entity_handle(L, 2);
+    lua_pushboolean(L, *a == *b);
+    return 1;
+}
+
+void register_entity_bindings(lua_State* L)
+{
+    lua_register(L, "entity_new", cmt_entity_new);
+    lua_register(L, "entity_destroy", cmt_entity_destroy);
+    lua_register(L, "entity_set_sprite", cmt_entity_set_sprite);
+    lua_register(L, "entity_count", cmt_entity_count);
+    lua_register(L, "entities_draw", cmt_entities_draw);
+
+    if (!luaL_newmetatable(L, "__mt_entity"))
+        printf("Lua error: Entity metatable at __mt_entity already exists\n");
+
+    lua_pushcfunction(L, cmt_entity_index);
+    lua_setfield(L, -2, "__index");
+    lua_pushcfunction(L, cmt_entity_newindex);
+    lua_setfield(L, -2, "__newindex");
+    lua_pushcfunction(L, cmt_entity_eq);
+    lua_setfield(L, -2, "__eq");
+    lua_pop(L, 1);
+}
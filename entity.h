@@ -0,0 +1,73 @@
+#ifndef ENTITY_H
+#define ENTITY_H
+
+#include <stdint.h>
+#include "comet.h"
+#include "serialize.h"
+
+// handles pack a slot index with a generation so stale handles can be detected
+#define ENTITY_INDEX_BITS 20
+#define ENTITY_INDEX_MASK ((1u << ENTITY_INDEX_BITS) - 1)
+#define ENTITY_MAX_COUNT (1 << ENTITY_INDEX_BITS)
+
+typedef uint32_t EntityHandle;
+
+enum
+{
+    ENTITY_VISIBLE = 1 << 0,
+    ENTITY_HAS_SPRITE = 1 << 1,
+    ENTITY_IN_VIEW = 1 << 2
+};
+
+// components are stored as parallel dense arrays, an entity's components share the same dense index
+typedef struct EntityStore
+{
+    int count;
+    int capacity;
+
+    float* x;
+    float* y;
+    float* vx;
+    float* vy;
+    float* width;
+    float* height;
+    unsigned char* flags;
+    const Texture2D** image;
+    Rectangle* region;
+    int* image_ref;
+    EntityHandle* handle;
+
+    // handle index to dense index and the generation that index is currently on
+    int* sparse;
+    uint16_t* generation;
+    int slot_count;
+    int slot_capacity;
+    int* free_slots;
+    int free_count;
+} EntityStore;
+
+extern EntityStore entity_store;
+
+// returns the dense index of a live handle, or -1
+int entity_lookup(EntityHandle handle);
+
+// movement system, integrates velocities over dt
+void entity_update(float dt);
+
+// releases every entity, called when the Lua state that owns their sprites is closed
+void entity_reset(void);
+
+// pushes a new view of an entity, also used to decode serialized handles
+void entity_push_handle(lua_State* L, EntityHandle handle);
+
+// appends the state of every entity, sprites are saved as the registry references of their images
+// and images lists those references, which stay held until it is given to entity_snapshot_release
+void entity_snapshot_save(SerialBuffer* buffer, SerialBuffer* images);
+void entity_snapshot_release(lua_State* L, SerialBuffer* images);
+
+// replaces the store with a saved state, returns false when the data does not describe a store
+bool entity_snapshot_restore(lua_State* L, const unsigned char* data, size_t size);
+
+void register_entity_bindings(lua_State* L);
+
+#endif //ENTITY_H
@@ -0,0 +1,138 @@
+#include "frame.h"
+#include "scheduler.h"
+
+#define FRAME_MAX_KEYS 512
+#define FRAME_MAX_MOUSE_BUTTONS 7
+
+static bool reactive = false;
+static bool dirty = true;
+
+// set by native systems and worker threads that need the next frame
+static int requested = 0;
+static double dirty_until = 0;
+static double last_run = 0;
+static float delta = 0;
+
+// EndDrawing polls input itself, polling again before the next check would drop presses it saw
+static bool polled = false;
+
+static bool input_detected(void)
+{
+    const Vector2 mouse_delta = GetMouseDelta();
+    const Vector2 wheel = GetMouseWheelMoveV();
+    if (mouse_delta.x != 0 || mouse_delta.y != 0 || wheel.x != 0 || wheel.y != 0 || GetTouchPointCount() > 0)
+        return true;
+
+    for (int button = 0; button < FRAME_MAX_MOUSE_BUTTONS; ++button)
+    {
+        if (IsMouseButtonDown(button) || IsMouseButtonReleased(button))
+            return true;
+    }
+
+    // queries the key state directly so the pressed key queue is left for the script
+    for (int key = 1; key < FRAME_MAX_KEYS; ++key)
+    {
+        if (IsKeyDown(key) || IsKeyReleased(key))
+            return true;
+    }
+
+    return IsGamepadAvailable(0) && GetGamepadButtonPressed() != GAMEPAD_BUTTON_UNKNOWN;
+}
+
+bool frame_begin(const bool script_active)
+{
+    const double now = GetTime();
+
+    if (!reactive || !script_active)
+    {
+        delta = GetFrameTime();
+        last_run = now;
+        polled = true;
+        return true;
+    }
+
+    if (!polled)
+        PollInputEvents();
+    polled = false;
+
+    // script timers are measured in scheduler time, which only advances on frames that run
+    const double idle = now - last_run;
+    const double wake = scheduler_next_wake();
+    const bool timer_due = wake >= 0 && idle >= wake;
+
+    const bool request = __atomic_exchange_n(&requested, 0, __ATOMIC_ACQ_REL) != 0;
+
+    if (dirty || request || now < dirty_until || timer_due || IsWindowResized() || input_detected())
+    {
+        dirty = false;
+        delta = (float)idle;
+        last_run = now;
+        polled = true;
+        return true;
+    }
+
+#ifndef __EMSCRIPTEN__
+    // the browser drives the web loop, sleeping there would only block the page
+    double wait = FRAME_IDLE_POLL_INTERVAL;
+    if (wake >= 0 && wake - idle < wait)
+        wait = wake - idle;
+    if (dirty_until > now && dirty_until - now < wait)
+        wait = dirty_until - now;
+    WaitTime(wait);
+#endif
+
+    return false;
+}
+
+float frame_delta(void)
+{
+    return delta < FRAME_MAX_DELTA ? delta : FRAME_MAX_DELTA;
+}
+
+float frame_scheduler_delta(void)
+{
+    return delta;
+}
+
+void frame_request(void)
+{
+    __atomic_store_n(&requested, 1, __ATOMIC_RELEASE);
+}
+
+// MARK: Lua Functions
+
+static int cmt_frame_set_reactive(lua_State* L)
+{
+    luaL_checktype(L, 1, LUA_TBOOLEAN);
+    reactive = lua_toboolean(L, 1);
+    dirty = true;
+    return 0;
+}
+
+static int cmt_frame_invalidate(lua_State* L)
+{
+    // an optional duration keeps frames coming, for transitions and animations
+    const lua_Number duration = luaL_optnumber(L, 1, 0);
+    dirty = true;
+    if (duration > 0 && GetTime() + duration > dirty_until)
+        dirty_until = GetTime() + duration;
+    return 0;
+}
+
+static int cmt_frame_is_reactive(lua_State* L)
+{
+    lua_pushboolean(L, reactive);
+    return 1;
+}
+
+void register_frame_bindings(lua_State* L)
+{
+    // every new state starts in continuous mode and opts in from its main script
+    reactive = false;
+    dirty = true;
+    dirty_until = 0;
+
+    lua_register(L, "frame_set_reactive", cmt_frame_set_reactive);
+    lua_register(L, "frame_invalidate", cmt_frame_invalidate);
+    lua_register(L, "frame_is_reactive", cmt_frame_is_reactive);
+}
@@ -0,0 +1,26 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+#include "comet.h"
+
+// how long an idle reactive loop sleeps between input polls on desktop
+#define FRAME_IDLE_POLL_INTERVAL 0.008
+
+// the most native systems advance in one frame, so the first frame after an idle stretch does not teleport
+#define FRAME_MAX_DELTA 0.1f
+
+// decides whether this loop iteration updates and draws, idle iterations only poll input
+bool frame_begin(bool script_active);
+
+// time the native systems should advance by this frame, clamped to FRAME_MAX_DELTA
+float frame_delta(void);
+
+// the full time since the last frame that ran, so sleeping tasks still wake on schedule after an idle stretch
+float frame_scheduler_delta(void);
+
+// asks for the next reactive frame, for native systems that are still changing, safe to call from any thread
+void frame_request(void);
+
+void register_frame_bindings(lua_State* L);
+
+#endif //FRAME_H
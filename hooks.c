@@ -0,0 +1,56 @@
+#include "hooks.h"
+
+static HookFunction functions[HOOK_CLIENT_COUNT] = {0};
+static int intervals[HOOK_CLIENT_COUNT] = {0};
+static int counters[HOOK_CLIENT_COUNT] = {0};
+
+// the count the hook is installed with, the smallest interval of all clients
+static int hook_count = 0;
+
+static void dispatch_hook(lua_State* L, lua_Debug* ar)
+{
+    // coroutines keep the hook they inherited, they drop it themselves once every client is gone
+    if (hook_count == 0)
+    {
+        lua_sethook(L, NULL, 0, 0);
+        return;
+    }
+
+    // an older coroutine may still run at the count it inherited, credit what actually ran and bring it in line
+    const int count = lua_gethookcount(L);
+    if (count != hook_count)
+        lua_sethook(L, dispatch_hook, LUA_MASKCOUNT, hook_count);
+
+    for (int i = 0; i < HOOK_CLIENT_COUNT; ++i)
+    {
+        if (functions[i] == NULL)
+            continue;
+
+        counters[i] += count;
+        if (counters[i] >= intervals[i])
+        {
+            counters[i] = 0;
+            functions[i](L);
+        }
+    }
+}
+
+void hooks_set(lua_State* L, const HookClient client, const HookFunction function, const int interval)
+{
+    functions[client] = function;
+    intervals[client] = interval;
+    counters[client] = 0;
+
+    hook_count = 0;
+    for (int i = 0; i < HOOK_CLIENT_COUNT; ++i)
+    {
+        if (functions[i] != NULL && (hook_count == 0 || intervals[i] < hook_count))
+            hook_count = intervals[i];
+    }
+
+    // coroutines created from now on inherit the hook from the state that creates them
+    if (hook_count == 0)
+        lua_sethook(L, NULL, 0, 0);
+    else
+        lua_sethook(L, dispatch_hook, LUA_MASKCOUNT, hook_count);
+}
@@ -0,0 +1,19 @@
+#ifndef HOOKS_H
+#define HOOKS_H
+
+#include "comet.h"
+
+typedef void (*HookFunction)(lua_State* L);
+
+// Lua has a single debug hook per thread, every engine system that needs one shares it through here
+typedef enum HookClient
+{
+    HOOK_PROFILER,
+    HOOK_WATCHDOG,
+    HOOK_CLIENT_COUNT
+} HookClient;
+
+// calls function roughly every interval VM instructions, a NULL function removes the client
+void hooks_set(lua_State* L, HookClient client, HookFunction function, int interval);
+
+#endif //HOOKS_H
@@ -0,0 +1,322 @@
+#include "jobs.h"
+#include <stdlib.h>
+
+// web builds only get threads when compiled with -pthread, otherwise every job runs inline
+#if !defined(__EMSCRIPTEN__) || defined(__EMSCRIPTEN_PTHREADS__)
+#define JOBS_THREADED 1
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#endif
+
+#define PARALLEL_FOR_MAX_BATCHES 256
+
+typedef struct RangeJob
+{
+    JobRangeFunction function;
+    void* data;
+    int start;
+    int end;
+} RangeJob;
+
+static JobCounter frame_counter = {0};
+
+static void execute_job(const Job* job)
+{
+    job->function(job->data);
+    if (job->counter != NULL)
+        __atomic_sub_fetch(&job->counter->pending, 1, __ATOMIC_ACQ_REL);
+}
+
+#ifdef JOBS_THREADED
+
+// each thread owns a deque, it pushes and pops at the tail while idle threads steal from the head
+typedef struct JobQueue
+{
+    Job jobs[JOBS_QUEUE_CAPACITY];
+    unsigned int head;
+    unsigned int tail;
+    pthread_mutex_t lock;
+} JobQueue;
+
+static JobQueue queues[JOBS_MAX_WORKERS + 1];
+static pthread_t threads[JOBS_MAX_WORKERS];
+static int worker_count = 0;
+static int started_count = 0;
+static volatile int running = 0;
+
+// idle workers sleep until the number of queued jobs is non-zero
+static pthread_mutex_t sleep_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sleep_cond = PTHREAD_COND_INITIALIZER;
+static volatile int queued = 0;
+
+// 0 is the main thread, workers are numbered from 1
+static __thread int thread_index = 0;
+
+// MARK: Queues
+
+static bool queue_push(JobQueue* queue, const Job* job)
+{
+    pthread_mutex_lock(&queue->lock);
+    const bool full = queue->tail - queue->head == JOBS_QUEUE_CAPACITY;
+    if (!full)
+    {
+        queue->jobs[queue->tail % JOBS_QUEUE_CAPACITY] = *job;
+        queue->tail++;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return !full;
+}
+
+static bool queue_pop(JobQueue* queue, Job* job)
+{
+    pthread_mutex_lock(&queue->lock);
+    const bool empty = queue->tail == queue->head;
+    if (!empty)
+    {
+        queue->tail--;
+        *job = queue->jobs[queue->tail % JOBS_QUEUE_CAPACITY];
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return !empty;
+}
+
+static bool queue_steal(JobQueue* queue, Job* job)
+{
+    pthread_mutex_lock(&queue->lock);
+    const bool empty = queue->tail == queue->head;
+    if (!empty)
+    {
+        *job = queue->jobs[queue->head % JOBS_QUEUE_CAPACITY];
+        queue->head++;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return !empty;
+}
+
+static bool find_job(const int index, Job* job)
+{
+    // newest local work first since it is most likely to still be in cache
+    if (queue_pop(&queues[index], job))
+        return true;
+
+    const int thread_count = worker_count + 1;
+    for (int i = 1; i < thread_count; ++i)
+    {
+        if (queue_steal(&queues[(index + i) % thread_count], job))
+            return true;
+    }
+
+    return false;
+}
+
+static bool try_execute(const int index)
+{
+    Job job;
+    if (!find_job(index, &job))
+        return false;
+
+    __atomic_sub_fetch(&queued, 1, __ATOMIC_ACQ_REL);
+    execute_job(&job);
+    return true;
+}
+
+// MARK: Workers
+
+static void* worker_main(void* arg)
+{
+    thread_index = (int)(size_t)arg;
+
+    while (__atomic_load_n(&running, __ATOMIC_ACQUIRE))
+    {
+        if (try_execute(thread_index))
+            continue;
+
+        pthread_mutex_lock(&sleep_lock);
+        while (__atomic_load_n(&running, __ATOMIC_ACQUIRE) && __atomic_load_n(&queued, __ATOMIC_ACQUIRE) <= 0)
+            pthread_cond_wait(&sleep_cond, &sleep_lock);
+        pthread_mutex_unlock(&sleep_lock);
+    }
+
+    return NULL;
+}
+
+void jobs_initialise(int count)
+{
+    if (count > JOBS_MAX_WORKERS)
+        count = JOBS_MAX_WORKERS;
+
+    for (int i = 0; i <= count; ++i)
+    {
+        queues[i].head = 0;
+        queues[i].tail = 0;
+        pthread_mutex_init(&queues[i].lock, NULL);
+    }
+
+    // set before any worker starts reading it, a worker that fails to start just leaves an empty deque behind
+    running = 1;
+    worker_count = count;
+    started_count = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        if (pthread_create(&threads[i], NULL, worker_main, (void*)(size_t)(i + 1)) != 0)
+            break;
+        started_count++;
+    }
+}
+
+void jobs_shutdown(void)
+{
+    jobs_end_frame();
+
+    pthread_mutex_lock(&sleep_lock);
+    __atomic_store_n(&running, 0, __ATOMIC_RELEASE);
+    pthread_cond_broadcast(&sleep_cond);
+    pthread_mutex_unlock(&sleep_lock);
+
+    for (int i = 0; i < started_count; ++i)
+        pthread_join(threads[i], NULL);
+
+    for (int i = 0; i <= worker_count; ++i)
+        pthread_mutex_destroy(&queues[i].lock);
+
+    worker_count = 0;
+    started_count = 0;
+}
+
+int jobs_thread_count(void)
+{
+    return started_count + 1;
+}
+
+int jobs_default_worker_count(void)
+{
+#ifdef _SC_NPROCESSORS_ONLN
+    const long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cores > 1)
+        return cores - 1 > JOBS_MAX_WORKERS ? JOBS_MAX_WORKERS : (int)(cores - 1);
+#endif
+    return 0;
+}
+
+void jobs_run(const JobFunction function, void* data, JobCounter* counter)
+{
+    if (counter == NULL)
+        counter = &frame_counter;
+
+    __atomic_add_fetch(&counter->pending, 1, __ATOMIC_ACQ_REL);
+    const Job job = {function, data, counter};
+
+    if (started_count == 0)
+    {
+        execute_job(&job);
+        return;
+    }
+
+    // count the job before it becomes visible so a thief can never take queued below zero
+    __atomic_add_fetch(&queued, 1, __ATOMIC_ACQ_REL);
+    if (!queue_push(&queues[thread_index], &job))
+    {
+        // the local deque is full, doing the work now is the only way forward
+        __atomic_sub_fetch(&queued, 1, __ATOMIC_ACQ_REL);
+        execute_job(&job);
+        return;
+    }
+
+    pthread_mutex_lock(&sleep_lock);
+    pthread_cond_signal(&sleep_cond);
+    pthread_mutex_unlock(&sleep_lock);
+}
+
+void jobs_wait(JobCounter* counter)
+{
+    while (__atomic_load_n(&counter->pending, __ATOMIC_ACQUIRE) > 0)
+    {
+        // the waiting thread helps instead of blocking
+        if (!try_execute(thread_index))
+            sched_yield();
+    }
+}
+
+#else
+
+void jobs_initialise(int count)
+{
+}
+
+void jobs_shutdown(void)
+{
+}
+
+int jobs_thread_count(void)
+{
+    return 1;
+}
+
+int jobs_default_worker_count(void)
+{
+    return 0;
+}
+
+void jobs_run(const JobFunction function, void* data, JobCounter* counter)
+{
+    const Job job = {function, data, NULL};
+    execute_job(&job);
+}
+
+void jobs_wait(JobCounter* counter)
+{
+}
+
+#endif
+
+// MARK: Helpers
+
+static void run_range_job(void* data)
+{
+    const RangeJob* range = data;
+    range->function(range->data, range->start, range->end);
+}
+
+void jobs_parallel_for(const int count, int batch_size, const JobRangeFunction function, void* data)
+{
+    if (count <= 0)
+        return;
+
+    if (batch_size < 1)
+        batch_size = 1;
+
+    // small ranges or a single thread are not worth splitting
+    if (jobs_thread_count() == 1 || count <= batch_size)
+    {
+        function(data, 0, count);
+        return;
+    }
+
+    int batch_count = (count + batch_size - 1) / batch_size;
+    if (batch_count > PARALLEL_FOR_MAX_BATCHES)
+    {
+        batch_count = PARALLEL_FOR_MAX_BATCHES;
+        batch_size = (count + batch_count - 1) / batch_count;
+        batch_count = (count + batch_size - 1) / batch_size;
+    }
+
+    RangeJob ranges[PARALLEL_FOR_MAX_BATCHES];
+    JobCounter counter = {0};
+
+    // the calling thread keeps the first batch for itself
+    for (int i = 1; i < batch_count; ++i)
+    {
+        const int end = (i + 1) * batch_size;
+        ranges[i] = (RangeJob){function, data, i * batch_size, end < count ? end : count};
+        jobs_run(run_range_job, &ranges[i], &counter);
+    }
+
+    function(data, 0, batch_size);
+    jobs_wait(&counter);
+}
+
+void jobs_end_frame(void)
+{
+    jobs_wait(&frame_counter);
+}
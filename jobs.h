@@ -0,0 +1,47 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <stdbool.h>
+
+#define JOBS_MAX_WORKERS 32
+#define JOBS_QUEUE_CAPACITY 4096
+
+typedef void (*JobFunction)(void* data);
+typedef void (*JobRangeFunction)(void* data, int start, int end);
+
+// counts jobs that are still pending, wait on it to depend on a group of jobs
+typedef struct JobCounter
+{
+    volatile int pending;
+} JobCounter;
+
+typedef struct Job
+{
+    JobFunction function;
+    void* data;
+    JobCounter* counter;
+} Job;
+
+// starts worker_count background workers, with zero every job runs inline on the calling thread
+void jobs_initialise(int worker_count);
+void jobs_shutdown(void);
+
+// number of threads that execute jobs, including the main thread
+int jobs_thread_count(void);
+
+// a sensible worker count for this machine, one less than the number of cores
+int jobs_default_worker_count(void);
+
+// queues a job, the counter (which may be NULL) is decremented once the job has run
+void jobs_run(JobFunction function, void* data, JobCounter* counter);
+
+// helps execute queued jobs until every job tracked by the counter has finished
+void jobs_wait(JobCounter* counter);
+
+// splits [0, count) into batches of at most batch_size and runs them across all threads, then waits
+void jobs_parallel_for(int count, int batch_size, JobRangeFunction function, void* data);
+
+// every job queued without an explicit counter belongs to the frame, this waits for all of them
+void jobs_end_frame(void);
+
+#endif //JOBS_H
@@ -0,0 +1,208 @@
+#include "layer.h"
+#include "bindings.h"
+#include "telemetry.h"
+#include <math.h>
+#include <string.h>
+
+// only one layer can be drawn into at a time, raylib has a single texture mode
+static Layer* active_layer = NULL;
+
+void layer_end_frame(void)
+{
+    if (active_layer == NULL)
+        return;
+
+    if (active_layer->has_dirty_rect)
+        EndScissorMode();
+    EndTextureMode();
+
+    // the layer stays dirty so it is redrawn in full next time
+    active_layer->drawing = false;
+    active_layer->has_dirty_rect = false;
+    active_layer = NULL;
+}
+
+static Layer* cmt_check_layer(lua_State* L, const int idx)
+{
+    return luaL_checkudata(L, idx, "__mt_layer");
+}
+
+static int cmt_layer_new(lua_State* L)
+{
+    const lua_Integer width = luaL_checkinteger(L, 1);
+    const lua_Integer height = luaL_checkinteger(L, 2);
+    luaL_argcheck(L, width > 0, 1, "width must be greater than zero");
+    luaL_argcheck(L, height > 0, 2, "height must be greater than zero");
+
+    const RenderTexture2D target = LoadRenderTexture((int)width, (int)height);
+    if (target.id == 0)
+        return luaL_error(L, "layer_new failed to create a %dx%d render texture", (int)width, (int)height);
+
+    Layer* layer = lua_newuserdata(L, sizeof(Layer));
+    memset(layer, 0, sizeof(Layer));
+    layer->target = target;
+    layer->dirty = true;
+
+    luaL_getmetatable(L, "__mt_layer");
+    lua_setmetatable(L, -2);
+
+    telemetry_texture_loaded(target.texture);
+    telemetry_userdata_created(TELEMETRY_LAYER);
+    return 1;
+}
+
+static int cmt_layer_gc(lua_State* L)
+{
+    Layer* layer = cmt_check_layer(L, 1);
+    if (layer == active_layer)
+        active_layer = NULL;
+
+    if (layer->target.id != 0)
+    {
+        telemetry_texture_unloaded(layer->target.texture);
+        UnloadRenderTexture(layer->target);
+        layer->target.id = 0;
+    }
+    return 0;
+}
+
+static int cmt_layer_begin(lua_State* L)
+{
+    Layer* layer = cmt_check_layer(L, 1);
+
+    // clean layers skip their draw calls entirely
+    if (!layer->dirty)
+    {
+        lua_pushboolean(L, false);
+        return 1;
+    }
+
+    if (active_layer != NULL)
+        return luaL_error(L, "layer_begin called while another layer is being drawn");
+
+    // texture mode resets the view, layers are drawn in their own space outside of camera_begin
+    BeginTextureMode(layer->target);
+    if (layer->has_dirty_rect)
+    {
+        const Rectangle* rect = &layer->dirty_rect;
+        BeginScissorMode((int)rect->x, (int)rect->y, (int)rect->width, (int)rect->height);
+    }
+
+    // the scissor test also limits the clear to the dirty rect
+    ClearBackground(BLANK);
+
+    layer->drawing = true;
+    active_layer = layer;
+
+    lua_pushboolean(L, true);
+    return 1;
+}
+
+static int cmt_layer_end(lua_State* L)
+{
+    Layer* layer = cmt_check_layer(L, 1);
+    if (!layer->drawing)
+        return luaL_error(L, "layer_end called without a matching layer_begin");
+
+    if (layer->has_dirty_rect)
+        EndScissorMode();
+    EndTextureMode();
+
+    layer->drawing = false;
+    layer->dirty = false;
+    layer->has_dirty_rect = false;
+    active_layer = NULL;
+    return 0;
+}
+
+static int cmt_layer_invalidate(lua_State* L)
+{
+    Layer* layer = cmt_check_layer(L, 1);
+
+    if (lua_isnoneornil(L, 2))
+    {
+        layer->dirty = true;
+        layer->has_dirty_rect = false;
+        return 0;
+    }
+
+    const Rectangle* rect = cmt_check_rect(L, 2, "rect");
+    if (!layer->dirty)
+    {
+        layer->dirty = true;
+        layer->has_dirty_rect = true;
+        layer->dirty_rect = *rect;
+    }
+    else if (layer->has_dirty_rect)
+    {
+        // grow the pending dirty rect to cover both areas
+        Rectangle* dirty = &layer->dirty_rect;
+        const float x = fminf(dirty->x, rect->x);
+        const float y = fminf(dirty->y, rect->y);
+        dirty->width = fmaxf(dirty->x + dirty->width, rect->x + rect->width) - x;
+        dirty->height = fmaxf(dirty->y + dirty->height, rect->y + rect->height) - y;
+        dirty->x = x;
+        dirty->y = y;
+    }
+
+    return 0;
+}
+
+static int cmt_layer_draw(lua_State* L)
+{
+    const Layer* layer = cmt_check_layer(L, 1);
+    const lua_Number x = luaL_checknumber(L, 2);
+    const lua_Number y = luaL_checknumber(L, 3);
+    const Color tint = lua_isnoneornil(L, 4) ? WHITE : *cmt_check_color(L, 4, "tint");
+
+    const Texture2D* texture = &layer->target.texture;
+
+    // render textures are stored upside down
+    const Rectangle source = {0, 0, (float)texture->width, -(float)texture->height};
+    const Rectangle dest = {(float)x, (float)y, (float)texture->width, (float)texture->height};
+    DrawTexturePro(*texture, source, dest, (Vector2){0, 0}, 0, tint);
+    return 0;
+}
+
+static int cmt_layer_index(lua_State* L)
+{
+    const Layer* layer = cmt_check_layer(L, 1);
+    const char* key = luaL_checkstring(L, 2);
+
+    if (strcmp(key, "width") == 0)
+    {
+        lua_pushinteger(L, layer->target.texture.width);
+    }
+    else if (strcmp(key, "height") == 0)
+    {
+        lua_pushinteger(L, layer->target.texture.height);
+    }
+    else if (strcmp(key, "dirty") == 0)
+    {
+        lua_pushboolean(L, layer->dirty);
+    }
+    else
+    {
+        return luaL_error(L, "Layer has no field \"%s\".", key);
+    }
+
+    return 1;
+}
+
+void register_layer_bindings(lua_State* L)
+{
+    lua_register(L, "layer_new", cmt_layer_new);
+    lua_register(L, "layer_begin", cmt_layer_begin);
+    lua_register(L, "layer_end", cmt_layer_end);
+    lua_register(L, "layer_invalidate", cmt_layer_invalidate);
+    lua_register(L, "layer_draw", cmt_layer_draw);
+
+    if (!luaL_newmetatable(L, "__mt_layer"))
+        printf("Lua error: Layer metatable at __mt_layer already exists\n");
+
+    lua_pushcfunction(L, cmt_layer_index);
+    lua_setfield(L, -2, "__index");
+    lua_pushcfunction(L, cmt_layer_gc);
+    lua_setfield(L, -2, "__gc");
+    lua_pop(L, 1);
+}
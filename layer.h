@@ -0,0 +1,23 @@
+#ifndef LAYER_H
+#define LAYER_H
+
+#include "comet.h"
+
+// a cached render target that is only redrawn after it has been invalidated
+typedef struct Layer
+{
+    RenderTexture2D target;
+    bool dirty;
+    bool drawing;
+
+    // when set, only this part of the layer is cleared and redrawn
+    bool has_dirty_rect;
+    Rectangle dirty_rect;
+} Layer;
+
+// closes a layer left open by a script error so the rest of the frame draws to the screen
+void layer_end_frame(void);
+
+void register_layer_bindings(lua_State* L);
+
+#endif //LAYER_H
@@ -3,8 +3,6 @@
 
 #ifdef DEBUG
 #include "debug_client.h"
-#else
-#include "bindings.h"
 #endif
 
 #endif
@@ -13,24 +11,60 @@
 #include <assert.h>
 
 #include "comet.h"
+#include "animation.h"
+#include "bindings.h"
+#include "entity.h"
+#include "frame.h"
+#include "jobs.h"
+#include "layer.h"
+#include "pack.h"
+#include "scheduler.h"
+#include "telemetry.h"
+#include "tween.h"
+#include "watchdog.h"
 
 void main_loop(void* arg)
 {
     Engine* engine = arg;
     lua_State* L = engine->L;
 
+    // reactive scripts only get a frame when input, a timer or an invalidation asks for one
+    if (!frame_begin(L != NULL && engine->script_active))
+        return;
+
+    allocator_begin_frame(&engine->allocator);
+
     BeginDrawing();
 
+    if (L != NULL && engine->script_active)
+    {
+        // native systems advance before the script sees the frame
+        animation_update(frame_delta());
+        entity_update(frame_delta());
+
+        // tween callbacks and tasks whose waits finished run before the update global
+        watchdog_begin("tasks");
+        tween_update(L, frame_delta());
+        scheduler_update(L, frame_scheduler_delta());
+        if (watchdog_end())
+            engine->script_active = false;
+    }
+
     if (L != NULL && engine->script_active)
     {
         lua_getglobal(L, "update");
         if (lua_isfunction(L, -1))
         {
+            watchdog_begin("update");
             if (lua_pcall(L, 0, 0, 0))
             {
                 printf("Lua error: %s\n", lua_tostring(L, -1));
                 engine->script_active = false;
             }
+
+            // hitting the hard limit stops the script even when it caught the error itself
+            if (watchdog_end())
+                engine->script_active = false;
         }
         else
         {
@@ -38,10 +72,18 @@ void main_loop(void* arg)
         }
     }
 
+    layer_end_frame();
+
     DrawFPS(0, 0);
+    telemetry_draw_overlay();
 
     EndDrawing();
 
+    // background work queued during the frame must not outlive it
+    jobs_end_frame();
+
+    telemetry_end_frame(engine);
+
     if (L != NULL && engine->script_active)
         assert(lua_gettop(L) == 0);
 }
@@ -50,8 +92,15 @@ int main(void)
 {
     SetConfigFlags(FLAG_VSYNC_HINT);
     InitWindow(600, 450, "game");
+    jobs_initialise(jobs_default_worker_count());
 
     Engine engine = {NULL, false};
+    allocator_initialise(&engine.allocator);
+
+#ifdef COMET_PACK_PATH
+    // builds that embed a compressed asset pack load every file through it
+    pack_mount(COMET_PACK_PATH);
+#endif
 
 #ifdef __EMSCRIPTEN__
 
@@ -72,11 +121,11 @@ int main(void)
     while (!WindowShouldClose()) main_loop(&engine);
 #endif
 
-    if (engine.L != NULL)
-    {
-        lua_close(engine.L);
-        engine.L = NULL;
-    }
+    close_lua(&engine);
+    pack_unmount();
+
+    allocator_destroy(&engine.allocator);
+    jobs_shutdown();
 
     CloseWindow();
     return 0;
@@ -0,0 +1,336 @@
+#include "pack.h"
+#include "util/lz4.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// the whole pack stays in memory, entries are decoded out of it on demand
+static unsigned char* blob = NULL;
+static const unsigned char* pack_data = NULL;
+static size_t pack_data_size = 0;
+
+static PackEntry* entries = NULL;
+static char* names = NULL;
+static int entry_count = 0;
+
+static uint32_t read_u32(const unsigned char* p)
+{
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+const char* pack_normalise_path(const char* file_path)
+{
+    while (true)
+    {
+        if (file_path[0] == '.' && file_path[1] == '/')
+            file_path += 2;
+        else if (file_path[0] == '/')
+            file_path++;
+        else
+            return file_path;
+    }
+}
+
+// MARK: Decoding
+
+bool pack_decode(const PackCodec codec, const unsigned char* src, const size_t src_size, unsigned char* dst, const size_t raw_size)
+{
+    switch (codec)
+    {
+    case PACK_CODEC_RAW:
+        if (src_size != raw_size)
+            return false;
+        memcpy(dst, src, raw_size);
+        return true;
+    case PACK_CODEC_LZ4:
+        return lz4_decompress(src, src_size, dst, raw_size);
+    default:
+        return false;
+    }
+}
+
+PackCodec pack_codec_from_name(const char* name)
+{
+    if (strcmp(name, "raw") == 0)
+        return PACK_CODEC_RAW;
+    if (strcmp(name, "lz4") == 0)
+        return PACK_CODEC_LZ4;
+    return PACK_CODEC_COUNT;
+}
+
+const PackEntry* pack_find(const char* file_path)
+{
+    if (entries == NULL)
+        return NULL;
+
+    const char* key = pack_normalise_path(file_path);
+    int low = 0;
+    int high = entry_count - 1;
+    while (low <= high)
+    {
+        const int middle = (low + high) / 2;
+        const int order = strcmp(key, entries[middle].path);
+        if (order == 0)
+            return &entries[middle];
+        if (order < 0)
+            high = middle - 1;
+        else
+            low = middle + 1;
+    }
+    return NULL;
+}
+
+unsigned char* pack_read(const PackEntry* entry, int* size)
+{
+    // decompression writes straight into the buffer handed to the caller, there is no staging copy
+    unsigned char* data = RL_MALLOC(entry->raw_size + 1);
+    if (data == NULL || !pack_decode(entry->codec, pack_data + entry->offset, entry->stored_size, data, entry->raw_size))
+    {
+        printf("Pack entry \"%s\" could not be decoded\n", entry->path);
+        RL_FREE(data);
+        *size = 0;
+        return NULL;
+    }
+
+    data[entry->raw_size] = '\0';
+    *size = (int)entry->raw_size;
+    return data;
+}
+
+// MARK: File Callbacks
+
+// raylib does not fall back to its own loader once a callback is set, so files outside the pack are read here
+static unsigned char* read_disk(const char* file_name, int* size)
+{
+    *size = 0;
+    FILE* file = fopen(file_name, "rb");
+    if (file == NULL)
+    {
+        printf("File \"%s\" could not be opened\n", file_name);
+        return NULL;
+    }
+
+    fseek(file, 0, SEEK_END);
+    const long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    unsigned char* data = length >= 0 ? RL_MALLOC((size_t)length + 1) : NULL;
+    if (data == NULL || fread(data, 1, (size_t)length, file) != (size_t)length)
+    {
+        printf("File \"%s\" could not be read\n", file_name);
+        RL_FREE(data);
+        fclose(file);
+        return NULL;
+    }
+
+    fclose(file);
+    data[length] = '\0';
+    *size = (int)length;
+    return data;
+}
+
+static unsigned char* load_file_data(const char* file_name, int* data_size)
+{
+    const PackEntry* entry = pack_find(file_name);
+    if (entry != NULL)
+        return pack_read(entry, data_size);
+    return read_disk(file_name, data_size);
+}
+
+static char* load_file_text(const char* file_name)
+{
+    int size = 0;
+    return (char*)load_file_data(file_name, &size);
+}
+
+// MARK: Mounting
+
+static bool parse_index(const size_t size)
+{
+    if (size < PACK_HEADER_SIZE || memcmp(blob, PACK_MAGIC, 4) != 0 || blob[4] != PACK_VERSION)
+        return false;
+
+    const uint32_t count = read_u32(blob + 8);
+    const uint32_t index_size = read_u32(blob + 12);
+    if (index_size > size - PACK_HEADER_SIZE)
+        return false;
+
+    const unsigned char* cur = blob + PACK_HEADER_SIZE;
+    const unsigned char* index_end = cur + index_size;
+    pack_data = index_end;
+    pack_data_size = size - PACK_HEADER_SIZE - index_size;
+
+    // every path is shorter than its index record, so the index size bounds the name storage
+    entries = calloc(count > 0 ? count : 1, sizeof(PackEntry));
+    names = malloc(index_size + 1);
+    char* name = names;
+
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        if (index_end - cur < 2)
+            return false;
+        const size_t length = (size_t)cur[0] | (size_t)cur[1] << 8;
+        cur += 2;
+        if ((size_t)(index_end - cur) < length + 13)
+            return false;
+
+        memcpy(name, cur, length);
+        name[length] = '\0';
+        cur += length;
+
+        PackEntry* entry = &entries[i];
+        entry->path = name;
+        entry->codec = cur[0];
+        entry->offset = read_u32(cur + 1);
+        entry->stored_size = read_u32(cur + 5);
+        entry->raw_size = read_u32(cur + 9);
+        cur += 13;
+        name += length + 1;
+
+        if (entry->codec >= PACK_CODEC_COUNT || entry->offset > pack_data_size || entry->stored_size > pack_data_size - entry->offset)
+            return false;
+
+        // lookups are a binary search, so the packer has to write the index in order
+        if (i > 0 && strcmp(entries[i - 1].path, entry->path) >= 0)
+            return false;
+    }
+
+    entry_count = (int)count;
+    return true;
+}
+
+bool pack_mount(const char* file_path)
+{
+    pack_unmount();
+
+    int size = 0;
+    blob = read_disk(file_path, &size);
+    if (blob == NULL)
+        return false;
+
+    if (!parse_index((size_t)size))
+    {
+        printf("Pack \"%s\" is not a valid asset pack\n", file_path);
+        pack_unmount();
+        return false;
+    }
+
+    SetLoadFileDataCallback(load_file_data);
+    SetLoadFileTextCallback(load_file_text);
+    printf("Mounted pack \"%s\" with %d files\n", file_path, entry_count);
+    return true;
+}
+
+void pack_unmount(void)
+{
+    SetLoadFileDataCallback(NULL);
+    SetLoadFileTextCallback(NULL);
+
+    RL_FREE(blob);
+    free(entries);
+    free(names);
+    blob = NULL;
+    entries = NULL;
+    names = NULL;
+    entry_count = 0;
+    pack_data = NULL;
+    pack_data_size = 0;
+}
+
+// MARK: Lua
+
+int pack_load_lua(lua_State* L, const char* file_path)
+{
+    const PackEntry* entry = pack_find(file_path);
+    if (entry == NULL)
+        return luaL_loadfile(L, file_path);
+
+    int size = 0;
+    unsigned char* data = pack_read(entry, &size);
+    if (data == NULL)
+    {
+        lua_pushfstring(L, "cannot read %s from the asset pack", file_path);
+        return LUA_ERRFILE;
+    }
+
+    // chunk names start with @ so error messages show the path like loadfile does
+    lua_pushfstring(L, "@%s", file_path);
+    const int status = luaL_loadbuffer(L, (const char*)data, (size_t)size, lua_tostring(L, -1));
+    lua_remove(L, -2);
+    RL_FREE(data);
+    return status;
+}
+
+static int cmt_loadfile(lua_State* L)
+{
+    const char* file_path = luaL_optstring(L, 1, NULL);
+    const int status = file_path != NULL ? pack_load_lua(L, file_path) : luaL_loadfile(L, NULL);
+    if (status == 0)
+        return 1;
+
+    lua_pushnil(L);
+    lua_insert(L, -2);
+    return 2;
+}
+
+static int cmt_dofile(lua_State* L)
+{
+    const char* file_path = luaL_optstring(L, 1, NULL);
+    const int top = lua_gettop(L);
+    if ((file_path != NULL ? pack_load_lua(L, file_path) : luaL_loadfile(L, NULL)) != 0)
+        return lua_error(L);
+
+    lua_call(L, 0, LUA_MULTRET);
+    return lua_gettop(L) - top;
+}
+
+// package.loaders entry that resolves modules against package.path inside the pack
+static int cmt_pack_loader(lua_State* L)
+{
+    const char* name = luaL_gsub(L, luaL_checkstring(L, 1), ".", "/");
+    lua_getglobal(L, "package");
+    lua_getfield(L, -1, "path");
+    const char* templates = lua_tostring(L, -1);
+    if (templates == NULL)
+        return 0;
+
+    while (*templates != '\0')
+    {
+        const char* end = strchr(templates, ';');
+        if (end == NULL)
+            end = templates + strlen(templates);
+
+        lua_pushlstring(L, templates, (size_t)(end - templates));
+        const char* file_path = luaL_gsub(L, lua_tostring(L, -1), "?", name);
+        if (pack_find(file_path) != NULL)
+        {
+            if (pack_load_lua(L, file_path) != 0)
+                return luaL_error(L, "error loading module '%s' from the asset pack:\n\t%s", lua_tostring(L, 1), lua_tostring(L, -1));
+            return 1;
+        }
+        lua_pop(L, 2);
+        templates = *end == ';' ? end + 1 : end;
+    }
+
+    lua_pushfstring(L, "\n\tno entry for '%s' in the asset pack", name);
+    return 1;
+}
+
+void register_pack_bindings(lua_State* L)
+{
+    // the stock versions read straight from disk and would miss everything inside the pack
+    lua_register(L, "loadfile", cmt_loadfile);
+    lua_register(L, "dofile", cmt_dofile);
+
+    // packed modules take priority over loose files, like every other load through the pack
+    lua_getglobal(L, "package");
+    lua_getfield(L, -1, "loaders");
+    for (int i = (int)lua_objlen(L, -1); i >= 2; --i)
+    {
+        lua_rawgeti(L, -1, i);
+        lua_rawseti(L, -2, i + 1);
+    }
+    lua_pushcfunction(L, cmt_pack_loader);
+    lua_rawseti(L, -2, 2);
+    lua_pop(L, 2);
+}
@@ -0,0 +1,53 @@
+#ifndef PACK_H
+#define PACK_H
+
+#include "comet.h"
+#include <stdint.h>
+
+#define PACK_MAGIC "CPAK"
+#define PACK_VERSION 1
+
+// magic, version, three reserved bytes, entry count and index size
+#define PACK_HEADER_SIZE 16
+
+typedef enum PackCodec
+{
+    PACK_CODEC_RAW,
+    PACK_CODEC_LZ4,
+    PACK_CODEC_COUNT
+} PackCodec;
+
+// index entries are sorted by path, data offsets are relative to the end of the index
+typedef struct PackEntry
+{
+    const char* path;
+    PackCodec codec;
+    uint32_t offset;
+    uint32_t stored_size;
+    uint32_t raw_size;
+} PackEntry;
+
+// reads the pack into memory and routes raylib file loads through it, files missing from the pack still load from disk
+bool pack_mount(const char* file_path);
+void pack_unmount(void);
+
+// pack paths are relative to the user directory, scripts may refer to them as "/x", "./x" or "x"
+const char* pack_normalise_path(const char* file_path);
+
+const PackEntry* pack_find(const char* file_path);
+
+// decodes an entry straight into a new buffer, with a terminator after the data for text, free with UnloadFileData
+unsigned char* pack_read(const PackEntry* entry, int* size);
+
+// turns stored bytes back into the original ones, dst must hold exactly raw_size bytes
+bool pack_decode(PackCodec codec, const unsigned char* src, size_t src_size, unsigned char* dst, size_t raw_size);
+
+PackCodec pack_codec_from_name(const char* name);
+
+// luaL_loadfile that looks inside the mounted pack first
+int pack_load_lua(lua_State* L, const char* file_path);
+
+// replaces loadfile, dofile and the Lua module searcher of a state opened with luaL_openlibs with ones that use the pack
+void register_pack_bindings(lua_State* L);
+
+#endif //PACK_H
@@ -0,0 +1,688 @@
+#include "pathfinding.h"
+#include "jobs.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DIAGONAL_COST 1.41421356f
+
+// opposite directions sit next to each other so i ^ 1 reverses a move
+static const int directions[8][2] = {{1, 0}, {-1, 0}, {0, 1}, {0, -1}, {1, 1}, {-1, -1}, {-1, 1}, {1, -1}};
+
+// one scratch per thread that can run queries at the same time, freed with the last grid
+static PathScratch* scratches = NULL;
+static int scratch_count = 0;
+static int live_grids = 0;
+
+// MARK: Heap
+
+static void heap_swap(PathScratch* scratch, const int a, const int b)
+{
+    const int node_a = scratch->heap[a];
+    const int node_b = scratch->heap[b];
+    scratch->heap[a] = node_b;
+    scratch->heap[b] = node_a;
+    scratch->heap_position[node_b] = a;
+    scratch->heap_position[node_a] = b;
+}
+
+static void heap_up(PathScratch* scratch, int i)
+{
+    while (i > 0)
+    {
+        const int parent = (i - 1) / 2;
+        if (scratch->f[scratch->heap[parent]] <= scratch->f[scratch->heap[i]])
+            break;
+
+        heap_swap(scratch, i, parent);
+        i = parent;
+    }
+}
+
+static void heap_down(PathScratch* scratch, int i)
+{
+    while (true)
+    {
+        const int left = i * 2 + 1;
+        const int right = left + 1;
+        int smallest = i;
+
+        if (left < scratch->heap_size && scratch->f[scratch->heap[left]] < scratch->f[scratch->heap[smallest]])
+            smallest = left;
+        if (right < scratch->heap_size && scratch->f[scratch->heap[right]] < scratch->f[scratch->heap[smallest]])
+            smallest = right;
+        if (smallest == i)
+            break;
+
+        heap_swap(scratch, i, smallest);
+        i = smallest;
+    }
+}
+
+static void heap_push(PathScratch* scratch, const int node)
+{
+    scratch->heap[scratch->heap_size] = node;
+    scratch->heap_position[node] = scratch->heap_size;
+    scratch->heap_size++;
+    heap_up(scratch, scratch->heap_size - 1);
+}
+
+static int heap_pop(PathScratch* scratch)
+{
+    const int top = scratch->heap[0];
+    scratch->heap_size--;
+    if (scratch->heap_size > 0)
+    {
+        scratch->heap[0] = scratch->heap[scratch->heap_size];
+        scratch->heap_position[scratch->heap[0]] = 0;
+        heap_down(scratch, 0);
+    }
+    return top;
+}
+
+// MARK: Search
+
+static void scratch_free(PathScratch* scratch)
+{
+    free(scratch->g);
+    free(scratch->f);
+    free(scratch->parent);
+    free(scratch->open_stamp);
+    free(scratch->closed_stamp);
+    free(scratch->heap);
+    free(scratch->heap_position);
+    free(scratch->path);
+    memset(scratch, 0, sizeof(PathScratch));
+}
+
+// grows a scratch to hold node_count nodes, leaving it empty when memory runs out
+static bool scratch_reserve(PathScratch* scratch, const int node_count)
+{
+    if (scratch->node_capacity >= node_count)
+        return true;
+
+    // the old contents are never needed, fresh zeroed stamps are valid for any stamp above zero
+    scratch_free(scratch);
+    scratch->g = malloc(sizeof(float) * node_count);
+    scratch->f = malloc(sizeof(float) * node_count);
+    scratch->parent = malloc(sizeof(int) * node_count);
+    scratch->open_stamp = calloc(node_count, sizeof(uint32_t));
+    scratch->closed_stamp = calloc(node_count, sizeof(uint32_t));
+    scratch->heap = malloc(sizeof(int) * node_count);
+    scratch->heap_position = malloc(sizeof(int) * node_count);
+    scratch->path = malloc(sizeof(int) * node_count);
+
+    if (scratch->g == NULL || scratch->f == NULL || scratch->parent == NULL || scratch->open_stamp == NULL ||
+        scratch->closed_stamp == NULL || scratch->heap == NULL || scratch->heap_position == NULL || scratch->path == NULL)
+    {
+        scratch_free(scratch);
+        return false;
+    }
+
+    scratch->node_capacity = node_count;
+    return true;
+}
+
+static void scratch_begin(PathScratch* scratch)
+{
+    // a fresh stamp marks every node as unvisited, the arrays only need clearing when it wraps,
+    // and then entirely since larger grids may have stamped nodes past this one's end
+    if (++scratch->stamp == 0)
+    {
+        memset(scratch->open_stamp, 0, sizeof(uint32_t) * scratch->node_capacity);
+        memset(scratch->closed_stamp, 0, sizeof(uint32_t) * scratch->node_capacity);
+        scratch->stamp = 1;
+    }
+
+    scratch->heap_size = 0;
+    scratch->path_length = 0;
+}
+
+// makes count scratches large enough for the grid available, raises an error when memory runs out
+static void grid_ensure_scratch(lua_State* L, const Grid* grid, const int count)
+{
+    if (scratch_count < count)
+    {
+        PathScratch* grown = realloc(scratches, sizeof(PathScratch) * count);
+        if (grown == NULL)
+        {
+            luaL_error(L, "not enough memory for %d path searches", count);
+            return;
+        }
+
+        memset(grown + scratch_count, 0, sizeof(PathScratch) * (count - scratch_count));
+        scratches = grown;
+        scratch_count = count;
+    }
+
+    for (int i = 0; i < count; ++i)
+    {
+        if (!scratch_reserve(&scratches[i], grid->width * grid->height))
+            luaL_error(L, "not enough memory to search a %dx%d grid", grid->width, grid->height);
+    }
+}
+
+static bool can_step(const Grid* grid, const int x, const int y, const int dx, const int dy)
+{
+    const int nx = x + dx;
+    const int ny = y + dy;
+    if (nx < 0 || ny < 0 || nx >= grid->width || ny >= grid->height || grid->cost[ny * grid->width + nx] == 0)
+        return false;
+
+    // diagonal moves may not cut the corner of a blocked cell
+    if (dx != 0 && dy != 0)
+        return grid->cost[y * grid->width + nx] != 0 && grid->cost[ny * grid->width + x] != 0;
+
+    return true;
+}
+
+static float octile_distance(const int ax, const int ay, const int bx, const int by)
+{
+    const int dx = abs(ax - bx);
+    const int dy = abs(ay - by);
+    return (float)(dx + dy) + (DIAGONAL_COST - 2) * (float)(dx < dy ? dx : dy);
+}
+
+static bool find_path(const Grid* grid, PathScratch* scratch, const int start, const int target)
+{
+    const int width = grid->width;
+    scratch_begin(scratch);
+
+    if (grid->cost[start] == 0 || grid->cost[target] == 0)
+        return false;
+
+    const int target_x = target % width;
+    const int target_y = target / width;
+    const uint32_t stamp = scratch->stamp;
+
+    scratch->g[start] = 0;
+    scratch->f[start] = octile_distance(start % width, start / width, target_x, target_y);
+    scratch->parent[start] = -1;
+    scratch->open_stamp[start] = stamp;
+    heap_push(scratch, start);
+
+    while (scratch->heap_size > 0)
+    {
+        const int current = heap_pop(scratch);
+        if (current == target)
+        {
+            int length = 0;
+            for (int node = target; node != -1; node = scratch->parent[node])
+                length++;
+
+            scratch->path_length = length;
+            for (int node = target; node != -1; node = scratch->parent[node])
+                scratch->path[--length] = node;
+
+            return true;
+        }
+
+        scratch->closed_stamp[current] = stamp;
+        const int x = current % width;
+        const int y = current / width;
+
+        for (int i = 0; i < 8; ++i)
+        {
+            const int dx = directions[i][0];
+            const int dy = directions[i][1];
+            if (!can_step(grid, x, y, dx, dy))
+                continue;
+
+            const int next = (y + dy) * width + (x + dx);
+            if (scratch->closed_stamp[next] == stamp)
+                continue;
+
+            const float step = (float)grid->cost[next] * (dx != 0 && dy != 0 ? DIAGONAL_COST : 1);
+            const float g = scratch->g[current] + step;
+
+            if (scratch->open_stamp[next] != stamp)
+            {
+                scratch->open_stamp[next] = stamp;
+                scratch->g[next] = g;
+                scratch->f[next] = g + octile_distance(x + dx, y + dy, target_x, target_y);
+                scratch->parent[next] = current;
+                heap_push(scratch, next);
+            }
+            else if (g < scratch->g[next])
+            {
+                scratch->g[next] = g;
+                scratch->f[next] = g + octile_distance(x + dx, y + dy, target_x, target_y);
+                scratch->parent[next] = current;
+                heap_up(scratch, scratch->heap_position[next]);
+            }
+        }
+    }
+
+    return false;
+}
+
+static void build_flow_field(FlowField* field, PathScratch* scratch, const int target)
+{
+    const Grid* grid = field->grid;
+    const int width = grid->width;
+    const int node_count = width * grid->height;
+    scratch_begin(scratch);
+
+    for (int i = 0; i < node_count; ++i)
+    {
+        field->distance[i] = INFINITY;
+        field->direction[i] = -1;
+    }
+
+    if (grid->cost[target] == 0)
+        return;
+
+    // Dijkstra outwards from the target, each cell then points at the neighbour it was reached from
+    const uint32_t stamp = scratch->stamp;
+    scratch->g[target] = 0;
+    scratch->f[target] = 0;
+    scratch->open_stamp[target] = stamp;
+    heap_push(scratch, target);
+
+    while (scratch->heap_size > 0)
+    {
+        const int current = heap_pop(scratch);
+        scratch->closed_stamp[current] = stamp;
+        field->distance[current] = scratch->g[current];
+
+        const int x = current % width;
+        const int y = current / width;
+
+        for (int i = 0; i < 8; ++i)
+        {
+            const int dx = directions[i][0];
+            const int dy = directions[i][1];
+            if (!can_step(grid, x, y, dx, dy))
+                continue;
+
+            const int next = (y + dy) * width + (x + dx);
+            if (scratch->closed_stamp[next] == stamp)
+                continue;
+
+            // walking from next into current pays the cost of current
+            const float g = scratch->g[current] + (float)grid->cost[current] * (dx != 0 && dy != 0 ? DIAGONAL_COST : 1);
+
+            if (scratch->open_stamp[next] != stamp || g < scratch->g[next])
+            {
+                const bool open = scratch->open_stamp[next] == stamp;
+                scratch->open_stamp[next] = stamp;
+                scratch->g[next] = g;
+                scratch->f[next] = g;
+
+                // the opposite direction of i leads from next back to current
+                field->direction[next] = (signed char)(i ^ 1);
+
+                if (open)
+                    heap_up(scratch, scratch->heap_position[next]);
+                else
+                    heap_push(scratch, next);
+            }
+        }
+    }
+}
+
+// MARK: Lua Helpers
+
+static Grid* cmt_check_grid(lua_State* L, const int idx)
+{
+    return luaL_checkudata(L, idx, "__mt_grid");
+}
+
+static FlowField* cmt_check_flow_field(lua_State* L, const int idx)
+{
+    return luaL_checkudata(L, idx, "__mt_flow_field");
+}
+
+static int cmt_check_cell(lua_State* L, const Grid* grid, const int x_idx)
+{
+    const lua_Integer x = luaL_checkinteger(L, x_idx);
+    const lua_Integer y = luaL_checkinteger(L, x_idx + 1);
+    luaL_argcheck(L, x >= 0 && x < grid->width, x_idx, "x is outside the grid");
+    luaL_argcheck(L, y >= 0 && y < grid->height, x_idx + 1, "y is outside the grid");
+    return (int)(y * grid->width + x);
+}
+
+static unsigned char check_cost(lua_State* L, const lua_Number cost, const int arg)
+{
+    luaL_argcheck(L, cost >= 0 && cost <= 255, arg, "cost must be between 0 and 255");
+    return (unsigned char)cost;
+}
+
+// writes the path as a flat x, y sequence into the table at idx and clears anything left from a longer path
+static void write_path(lua_State* L, const int idx, const Grid* grid, const PathScratch* scratch)
+{
+    const int old_length = (int)lua_objlen(L, idx);
+
+    for (int i = 0; i < scratch->path_length; ++i)
+    {
+        lua_pushinteger(L, scratch->path[i] % grid->width);
+        lua_rawseti(L, idx, i * 2 + 1);
+        lua_pushinteger(L, scratch->path[i] / grid->width);
+        lua_rawseti(L, idx, i * 2 + 2);
+    }
+
+    for (int i = scratch->path_length * 2 + 1; i <= old_length; ++i)
+    {
+        lua_pushnil(L);
+        lua_rawseti(L, idx, i);
+    }
+}
+
+// MARK: Grid Functions
+
+static int cmt_grid_new(lua_State* L)
+{
+    const lua_Integer width = luaL_checkinteger(L, 1);
+    const lua_Integer height = luaL_checkinteger(L, 2);
+    luaL_argcheck(L, width > 0 && width <= GRID_MAX_SIZE, 1, lua_pushfstring(L, "width must be between 1 and %d", GRID_MAX_SIZE));
+    luaL_argcheck(L, height > 0 && height <= GRID_MAX_SIZE, 2, lua_pushfstring(L, "height must be between 1 and %d", GRID_MAX_SIZE));
+
+    const int node_count = (int)(width * height);
+    Grid* grid = lua_newuserdata(L, sizeof(Grid));
+    memset(grid, 0, sizeof(Grid));
+
+    luaL_getmetatable(L, "__mt_grid");
+    lua_setmetatable(L, -2);
+    live_grids++;
+
+    grid->width = (int)width;
+    grid->height = (int)height;
+    grid->cost = malloc(node_count);
+    if (grid->cost == NULL)
+        return luaL_error(L, "not enough memory for a %dx%d grid", grid->width, grid->height);
+    memset(grid->cost, 1, node_count);
+
+    // costs are a flat row-major table, such as a tilemap layer
+    if (lua_istable(L, 3))
+    {
+        for (int i = 0; i < node_count; ++i)
+        {
+            lua_rawgeti(L, 3, i + 1);
+            if (lua_isnumber(L, -1))
+                grid->cost[i] = check_cost(L, lua_tonumber(L, -1), 3);
+            lua_pop(L, 1);
+        }
+    }
+
+    // the main thread's scratch is always available, batch queries add more on demand
+    grid_ensure_scratch(L, grid, 1);
+    return 1;
+}
+
+static int cmt_grid_gc(lua_State* L)
+{
+    Grid* grid = cmt_check_grid(L, 1);
+    free(grid->cost);
+    grid->cost = NULL;
+
+    // nothing is left to search, so the memory sized for the largest grid can go
+    if (--live_grids == 0)
+    {
+        for (int i = 0; i < scratch_count; ++i)
+            scratch_free(&scratches[i]);
+
+        free(scratches);
+        scratches = NULL;
+        scratch_count = 0;
+    }
+    return 0;
+}
+
+static int cmt_grid_set_cost(lua_State* L)
+{
+    Grid* grid = cmt_check_grid(L, 1);
+    const int cell = cmt_check_cell(L, grid, 2);
+    const unsigned char cost = check_cost(L, luaL_checknumber(L, 4), 4);
+
+    if (grid->cost[cell] != cost)
+    {
+        grid->cost[cell] = cost;
+        grid->version++;
+    }
+    return 0;
+}
+
+static int cmt_grid_get_cost(lua_State* L)
+{
+    const Grid* grid = cmt_check_grid(L, 1);
+    const int cell = cmt_check_cell(L, grid, 2);
+    lua_pushinteger(L, grid->cost[cell]);
+    return 1;
+}
+
+static int cmt_grid_find_path(lua_State* L)
+{
+    Grid* grid = cmt_check_grid(L, 1);
+    const int start = cmt_check_cell(L, grid, 2);
+    const int target = cmt_check_cell(L, grid, 4);
+
+    // reuse the caller's table when given one
+    if (lua_istable(L, 6))
+        lua_settop(L, 6);
+    else
+    {
+        lua_settop(L, 5);
+        lua_newtable(L);
+    }
+
+    grid_ensure_scratch(L, grid, 1);
+    PathScratch* scratch = &scratches[0];
+    find_path(grid, scratch, start, target);
+    write_path(L, 6, grid, scratch);
+
+    lua_pushinteger(L, scratch->path_length);
+    return 2;
+}
+
+typedef struct PathBatch
+{
+    Grid* grid;
+    const int* queries;
+} PathBatch;
+
+static void run_path_batch(void* data, const int start, const int end)
+{
+    const PathBatch* batch = data;
+    for (int i = start; i < end; ++i)
+        find_path(batch->grid, &scratches[i], batch->queries[i * 2], batch->queries[i * 2 + 1]);
+}
+
+static int cmt_grid_find_paths(lua_State* L)
+{
+    Grid* grid = cmt_check_grid(L, 1);
+    luaL_checktype(L, 2, LUA_TTABLE);
+    if (!lua_istable(L, 3))
+    {
+        lua_settop(L, 2);
+        lua_newtable(L);
+    }
+
+    // queries are flat sx, sy, tx, ty groups
+    const int query_count = (int)lua_objlen(L, 2) / 4;
+    const int thread_count = jobs_thread_count();
+    grid_ensure_scratch(L, grid, thread_count);
+
+    int cells[2 * JOBS_MAX_WORKERS + 2];
+    const PathBatch batch = {grid, cells};
+
+    // each round runs one query per thread, then copies the results out on the main thread
+    for (int first = 0; first < query_count; first += thread_count)
+    {
+        const int round = query_count - first < thread_count ? query_count - first : thread_count;
+        for (int i = 0; i < round; ++i)
+        {
+            int coords[4];
+            for (int c = 0; c < 4; ++c)
+            {
+                lua_rawgeti(L, 2, (first + i) * 4 + c + 1);
+                if (!lua_isnumber(L, -1))
+                    return luaL_error(L, "grid_find_paths query %d has a coordinate that is not a number", first + i + 1);
+                coords[c] = (int)lua_tointeger(L, -1);
+                lua_pop(L, 1);
+            }
+
+            const bool inside = coords[0] >= 0 && coords[0] < grid->width && coords[1] >= 0 && coords[1] < grid->height &&
+                                coords[2] >= 0 && coords[2] < grid->width && coords[3] >= 0 && coords[3] < grid->height;
+            if (!inside)
+                return luaL_error(L, "grid_find_paths query %d is outside the grid", first + i + 1);
+
+            cells[i * 2] = coords[1] * grid->width + coords[0];
+            cells[i * 2 + 1] = coords[3] * grid->width + coords[2];
+        }
+
+        jobs_parallel_for(round, 1, run_path_batch, (void*)&batch);
+
+        for (int i = 0; i < round; ++i)
+        {
+            lua_rawgeti(L, 3, first + i + 1);
+            if (!lua_istable(L, -1))
+            {
+                lua_pop(L, 1);
+                lua_newtable(L);
+                lua_pushvalue(L, -1);
+                lua_rawseti(L, 3, first + i + 1);
+            }
+
+            write_path(L, lua_gettop(L), grid, &scratches[i]);
+            lua_pop(L, 1);
+        }
+    }
+
+    return 1;
+}
+
+static int cmt_grid_index(lua_State* L)
+{
+    const Grid* grid = cmt_check_grid(L, 1);
+    const char* key = luaL_checkstring(L, 2);
+
+    if (strcmp(key, "width") == 0)
+    {
+        lua_pushinteger(L, grid->width);
+    }
+    else if (strcmp(key, "height") == 0)
+    {
+        lua_pushinteger(L, grid->height);
+    }
+    else
+    {
+        return luaL_error(L, "Grid has no field \"%s\".", key);
+    }
+
+    return 1;
+}
+
+// MARK: Flow Field Functions
+
+static int cmt_flow_field_new(lua_State* L)
+{
+    Grid* grid = cmt_check_grid(L, 1);
+    const int node_count = grid->width * grid->height;
+
+    FlowField* field = lua_newuserdata(L, sizeof(FlowField));
+    memset(field, 0, sizeof(FlowField));
+
+    luaL_getmetatable(L, "__mt_flow_field");
+    lua_setmetatable(L, -2);
+
+    // the environment table keeps the grid alive for as long as the field exists
+    lua_createtable(L, 1, 0);
+    lua_pushvalue(L, 1);
+    lua_rawseti(L, -2, 1);
+    lua_setfenv(L, -2);
+
+    field->grid = grid;
+    field->distance = malloc(sizeof(float) * node_count);
+    field->direction = malloc(node_count);
+    if (field->distance == NULL || field->direction == NULL)
+        return luaL_error(L, "not enough memory for a %dx%d flow field", grid->width, grid->height);
+    return 1;
+}
+
+static int cmt_flow_field_gc(lua_State* L)
+{
+    FlowField* field = cmt_check_flow_field(L, 1);
+    free(field->distance);
+    free(field->direction);
+    field->distance = NULL;
+    field->direction = NULL;
+    return 0;
+}
+
+static int cmt_flow_field_update(lua_State* L)
+{
+    FlowField* field = cmt_check_flow_field(L, 1);
+    Grid* grid = field->grid;
+    const int target = cmt_check_cell(L, grid, 2);
+    const int target_x = target % grid->width;
+    const int target_y = target / grid->width;
+
+    // the field is only rebuilt when the target moves or the grid costs change
+    const bool cached = field->valid && field->target_x == target_x && field->target_y == target_y &&
+                        field->version == grid->version;
+    if (!cached)
+    {
+        grid_ensure_scratch(L, grid, 1);
+        build_flow_field(field, &scratches[0], target);
+        field->target_x = target_x;
+        field->target_y = target_y;
+        field->version = grid->version;
+        field->valid = true;
+    }
+
+    lua_pushboolean(L, !cached);
+    return 1;
+}
+
+static int cmt_flow_field_direction(lua_State* L)
+{
+    const FlowField* field = cmt_check_flow_field(L, 1);
+    const int cell = cmt_check_cell(L, field->grid, 2);
+    const int direction = field->valid ? field->direction[cell] : -1;
+
+    // unreachable cells and the target itself have no direction
+    lua_pushinteger(L, direction == -1 ? 0 : directions[direction][0]);
+    lua_pushinteger(L, direction == -1 ? 0 : directions[direction][1]);
+    return 2;
+}
+
+static int cmt_flow_field_distance(lua_State* L)
+{
+    const FlowField* field = cmt_check_flow_field(L, 1);
+    const int cell = cmt_check_cell(L, field->grid, 2);
+
+    if (!field->valid || isinf(field->distance[cell]))
+        lua_pushnil(L);
+    else
+        lua_pushnumber(L, field->distance[cell]);
+    return 1;
+}
+
+void register_pathfinding_bindings(lua_State* L)
+{
+    lua_register(L, "grid_new", cmt_grid_new);
+    lua_register(L, "grid_set_cost", cmt_grid_set_cost);
+    lua_register(L, "grid_get_cost", cmt_grid_get_cost);
+    lua_register(L, "grid_find_path", cmt_grid_find_path);
+    lua_register(L, "grid_find_paths", cmt_grid_find_paths);
+    lua_register(L, "flow_field_new", cmt_flow_field_new);
+    lua_register(L, "flow_field_update", cmt_flow_field_update);
+    lua_register(L, "flow_field_direction", cmt_flow_field_direction);
+    lua_register(L, "flow_field_distance", cmt_flow_field_distance);
+
+    if (!luaL_newmetatable(L, "__mt_grid"))
+        printf("Lua error: Grid metatable at __mt_grid already exists\n");
+
+    lua_pushcfunction(L, cmt_grid_index);
+    lua_setfield(L, -2, "__index");
+    lua_pushcfunction(L, cmt_grid_gc);
+    lua_setfield(L, -2, "__gc");
+    lua_pop(L, 1);
+
+    if (!luaL_newmetatable(L, "__mt_flow_field"))
+        printf("Lua error: Flow field metatable at __mt_flow_field already exists\n");
+
+    lua_pushcfunction(L, cmt_flow_field_gc);
+    lua_setfield(L, -2, "__gc");
+    lua_pop(L, 1);
+}
@@ -0,0 +1,54 @@
+#ifndef PATHFINDING_H
+#define PATHFINDING_H
+
+#include <stdint.h>
+#include "comet.h"
+
+// largest width and height of a grid, a search scratch costs about 32 bytes per cell and every job thread gets one
+#define GRID_MAX_SIZE 1024
+
+// search state for one query at a time, stamps avoid clearing the arrays between queries
+// scratches are shared by every grid and sized for the largest one searched so far
+typedef struct PathScratch
+{
+    int node_capacity;
+    float* g;
+    float* f;
+    int* parent;
+    uint32_t* open_stamp;
+    uint32_t* closed_stamp;
+    uint32_t stamp;
+
+    // indexed binary heap over node ids ordered by f
+    int* heap;
+    int* heap_position;
+    int heap_size;
+
+    // the last path found, from start to target
+    int* path;
+    int path_length;
+} PathScratch;
+
+// a cost of 0 marks a blocked cell, anything else is the cost of entering that cell
+typedef struct Grid
+{
+    int width;
+    int height;
+    unsigned char* cost;
+    unsigned int version;
+} Grid;
+
+typedef struct FlowField
+{
+    Grid* grid;
+    float* distance;
+    signed char* direction;
+    int target_x;
+    int target_y;
+    unsigned int version;
+    bool valid;
+} FlowField;
+
+void register_pathfinding_bindings(lua_State* L);
+
+#endif //PATHFINDING_H
@@ -0,0 +1,215 @@
+#include "profiler.h"
+#include "hooks.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// everything is allocated up front so taking a sample never allocates
+static ProfilerSample samples[PROFILER_MAX_SAMPLES];
+static int sample_count = 0;
+static int dropped_count = 0;
+
+static ProfilerFrame frames[PROFILER_MAX_FRAMES];
+static int sort_order[PROFILER_MAX_SAMPLES];
+
+static bool running = false;
+static lua_State* main_state = NULL;
+static int sample_interval = PROFILER_DEFAULT_INTERVAL;
+
+// MARK: Sampling
+
+static unsigned int hash_frame(const char* source, const char* name, const int line)
+{
+    uintptr_t hash = (uintptr_t)source * 31 + (uintptr_t)name;
+    hash = hash * 31 + (unsigned int)line;
+    return (unsigned int)(hash ^ (hash >> 16));
+}
+
+static unsigned short intern_frame(lua_Debug* ar)
+{
+    // slot 0 catches everything once the table is full
+    const unsigned int start = hash_frame(ar->source, ar->name, ar->linedefined) % (PROFILER_MAX_FRAMES - 1);
+
+    for (unsigned int probe = 0; probe < PROFILER_MAX_FRAMES - 1; ++probe)
+    {
+        const unsigned short index = (unsigned short)(1 + (start + probe) % (PROFILER_MAX_FRAMES - 1));
+        ProfilerFrame* frame = &frames[index];
+
+        if (!frame->used)
+        {
+            frame->used = true;
+            frame->source = ar->source;
+            frame->name = ar->name;
+            frame->line = ar->linedefined;
+
+            const char* name = ar->name;
+            if (name == NULL)
+                name = strcmp(ar->what, "main") == 0 ? "main chunk" : "?";
+
+            if (ar->linedefined > 0)
+                snprintf(frame->label, PROFILER_LABEL_LENGTH, "%s %s:%d", name, ar->short_src, ar->linedefined);
+            else
+                snprintf(frame->label, PROFILER_LABEL_LENGTH, "%s %s", name, ar->short_src);
+
+            // semicolons separate frames in the folded format
+            for (char* c = frame->label; *c != '\0'; ++c)
+            {
+                if (*c == ';')
+                    *c = ':';
+            }
+
+            return index;
+        }
+
+        if (frame->source == ar->source && frame->name == ar->name && frame->line == ar->linedefined)
+            return index;
+    }
+
+    return 0;
+}
+
+static void profiler_hook(lua_State* L)
+{
+    if (sample_count == PROFILER_MAX_SAMPLES)
+    {
+        dropped_count++;
+        return;
+    }
+
+    ProfilerSample* sample = &samples[sample_count];
+    lua_Debug frame;
+    int depth = 0;
+
+    while (depth < PROFILER_MAX_DEPTH && lua_getstack(L, depth, &frame))
+    {
+        lua_getinfo(L, "Sn", &frame);
+        sample->frames[depth] = intern_frame(&frame);
+        depth++;
+    }
+
+    if (depth > 0)
+    {
+        sample->depth = (unsigned char)depth;
+        sample_count++;
+    }
+}
+
+void profiler_start(lua_State* L, const int interval)
+{
+    sample_count = 0;
+    dropped_count = 0;
+    memset(frames, 0, sizeof(frames));
+    strcpy(frames[0].label, "[unknown]");
+
+    sample_interval = interval > 0 ? interval : PROFILER_DEFAULT_INTERVAL;
+    hooks_set(L, HOOK_PROFILER, profiler_hook, sample_interval);
+    running = true;
+}
+
+void profiler_stop(lua_State* L)
+{
+    if (!running)
+        return;
+
+    hooks_set(L, HOOK_PROFILER, NULL, 0);
+    running = false;
+}
+
+bool profiler_running(void)
+{
+    return running;
+}
+
+// MARK: Output
+
+static int compare_samples(const void* a, const void* b)
+{
+    const ProfilerSample* sample_a = &samples[*(const int*)a];
+    const ProfilerSample* sample_b = &samples[*(const int*)b];
+
+    if (sample_a->depth != sample_b->depth)
+        return sample_a->depth - sample_b->depth;
+
+    return memcmp(sample_a->frames, sample_b->frames, sizeof(unsigned short) * sample_a->depth);
+}
+
+int profiler_write(FILE* file)
+{
+    // identical stacks end up next to each other and are counted as one line
+    for (int i = 0; i < sample_count; ++i)
+        sort_order[i] = i;
+    qsort(sort_order, sample_count, sizeof(int), compare_samples);
+
+    int stack_count = 0;
+    for (int i = 0; i < sample_count;)
+    {
+        int run = 1;
+        while (i + run < sample_count && compare_samples(&sort_order[i], &sort_order[i + run]) == 0)
+            run++;
+
+        // folded stacks list the outermost frame first
+        const ProfilerSample* sample = &samples[sort_order[i]];
+        for (int depth = sample->depth - 1; depth >= 0; --depth)
+            fprintf(file, depth > 0 ? "%s;" : "%s", frames[sample->frames[depth]].label);
+        fprintf(file, " %d\n", run);
+
+        stack_count++;
+        i += run;
+    }
+
+    if (dropped_count > 0)
+        printf("Profiler buffer was full, %d samples were dropped\n", dropped_count);
+
+    return stack_count;
+}
+
+// MARK: Lua Functions
+
+static int cmt_profiler_start(lua_State* L)
+{
+    const lua_Integer interval = luaL_optinteger(L, 1, PROFILER_DEFAULT_INTERVAL);
+    luaL_argcheck(L, interval >= 100, 1, "interval must be at least 100 instructions");
+
+    profiler_start(main_state, (int)interval);
+    return 0;
+}
+
+static int cmt_profiler_stop(lua_State* L)
+{
+    profiler_stop(main_state);
+    lua_pushinteger(L, sample_count);
+    return 1;
+}
+
+static int cmt_profiler_write(lua_State* L)
+{
+    const char* file_path = luaL_checkstring(L, 1);
+
+    FILE* file = fopen(file_path, "w");
+    if (file == NULL)
+        return luaL_error(L, "Could not open profile file \"%s\"", file_path);
+
+    const int stack_count = profiler_write(file);
+    fclose(file);
+
+    lua_pushinteger(L, stack_count);
+    return 1;
+}
+
+static int cmt_profiler_running(lua_State* L)
+{
+    lua_pushboolean(L, running);
+    return 1;
+}
+
+void register_profiler_bindings(lua_State* L)
+{
+    // hooks are per thread, new coroutines only inherit them from the state that creates them
+    main_state = L;
+    running = false;
+
+    lua_register(L, "profiler_start", cmt_profiler_start);
+    lua_register(L, "profiler_stop", cmt_profiler_stop);
+    lua_register(L, "profiler_write", cmt_profiler_write);
+    lua_register(L, "profiler_running", cmt_profiler_running);
+}
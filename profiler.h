@@ -0,0 +1,40 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdio.h>
+#include "comet.h"
+
+#define PROFILER_MAX_DEPTH 32
+#define PROFILER_MAX_SAMPLES 16384
+#define PROFILER_MAX_FRAMES 4096
+#define PROFILER_LABEL_LENGTH 96
+#define PROFILER_DEFAULT_INTERVAL 1000
+
+// a distinct function seen in a sample, source and name point at strings owned by the Lua state and only serve as a key
+typedef struct ProfilerFrame
+{
+    const char* source;
+    const char* name;
+    int line;
+    bool used;
+    char label[PROFILER_LABEL_LENGTH];
+} ProfilerFrame;
+
+// frame indices from the innermost call outwards
+typedef struct ProfilerSample
+{
+    unsigned short frames[PROFILER_MAX_DEPTH];
+    unsigned char depth;
+} ProfilerSample;
+
+// samples the call stack every interval VM instructions, earlier samples are discarded
+void profiler_start(lua_State* L, int interval);
+void profiler_stop(lua_State* L);
+bool profiler_running(void);
+
+// writes the samples as folded stacks, one "outer;inner count" line per distinct stack
+int profiler_write(FILE* file);
+
+void register_profiler_bindings(lua_State* L);
+
+#endif //PROFILER_H
@@ -0,0 +1,415 @@
+#include "scheduler.h"
+#include <stdlib.h>
+#include <string.h>
+
+static Task* tasks = NULL;
+static int task_capacity = 0;
+static int task_used = 0;
+static int live_tasks = 0;
+static int free_task = -1;
+static int current_task = -1;
+
+// sleeping tasks sit in these heaps and cost nothing until their wake point comes around
+static TimerHeap frame_timers = {0};
+static TimerHeap time_timers = {0};
+static unsigned int next_sequence = 0;
+
+static double frame_number = 0;
+static double elapsed = 0;
+
+// MARK: Timers
+
+static bool timer_before(const Timer* a, const Timer* b)
+{
+    // equal wake points resume in the order they were scheduled
+    return a->wake < b->wake || (a->wake == b->wake && a->sequence < b->sequence);
+}
+
+static void timer_push(TimerHeap* heap, const double wake, const int task)
+{
+    if (heap->count == heap->capacity)
+    {
+        heap->capacity = heap->capacity == 0 ? 64 : heap->capacity * 2;
+        heap->timers = realloc(heap->timers, sizeof(Timer) * heap->capacity);
+    }
+
+    int i = heap->count++;
+    const Timer timer = {wake, next_sequence++, task};
+
+    while (i > 0)
+    {
+        const int parent = (i - 1) / 2;
+        if (!timer_before(&timer, &heap->timers[parent]))
+            break;
+
+        heap->timers[i] = heap->timers[parent];
+        i = parent;
+    }
+
+    heap->timers[i] = timer;
+}
+
+static Timer timer_pop(TimerHeap* heap)
+{
+    const Timer top = heap->timers[0];
+    const Timer last = heap->timers[--heap->count];
+
+    int i = 0;
+    while (true)
+    {
+        int child = i * 2 + 1;
+        if (child + 1 < heap->count && timer_before(&heap->timers[child + 1], &heap->timers[child]))
+            child++;
+        if (child >= heap->count || !timer_before(&heap->timers[child], &last))
+            break;
+
+        heap->timers[i] = heap->timers[child];
+        i = child;
+    }
+
+    if (heap->count > 0)
+        heap->timers[i] = last;
+
+    return top;
+}
+
+// MARK: Tasks
+
+static int task_allocate(void)
+{
+    int index = free_task;
+    if (index != -1)
+    {
+        free_task = tasks[index].next_free;
+    }
+    else
+    {
+        if (task_used == task_capacity)
+        {
+            task_capacity = task_capacity == 0 ? 64 : task_capacity * 2;
+            tasks = realloc(tasks, sizeof(Task) * task_capacity);
+        }
+        index = task_used++;
+    }
+
+    live_tasks++;
+    tasks[index] = (Task){NULL, LUA_NOREF, LUA_NOREF, LUA_NOREF, -1, false, true, -1};
+    return index;
+}
+
+static void task_free(lua_State* L, const int index)
+{
+    Task* task = &tasks[index];
+    luaL_unref(L, LUA_REGISTRYINDEX, task->thread_ref);
+    luaL_unref(L, LUA_REGISTRYINDEX, task->handle_ref);
+    luaL_unref(L, LUA_REGISTRYINDEX, task->wait_ref);
+
+    task->thread = NULL;
+    task->alive = false;
+    task->next_free = free_task;
+    free_task = index;
+    live_tasks--;
+}
+
+static int check_current_task(lua_State* L, const char* name)
+{
+    if (current_task == -1 || tasks[current_task].thread != L)
+        luaL_error(L, "%s can only be called from a task started with spawn", name);
+
+    return current_task;
+}
+
+// pushes the results stored in the handle at idx onto to and returns how many there are
+static int push_handle_results(lua_State* L, const int idx, lua_State* to)
+{
+    lua_getfenv(L, idx);
+    lua_getfield(L, -1, "n");
+    const int count = (int)lua_tointeger(L, -1);
+    lua_pop(L, 1);
+
+    luaL_checkstack(to, count, "too many results");
+    for (int i = 1; i <= count; ++i)
+    {
+        lua_rawgeti(L, -1, i);
+        if (to != L)
+            lua_xmove(L, to, 1);
+        else
+            lua_insert(L, -2);
+    }
+
+    lua_pop(L, 1);
+    return count;
+}
+
+// stores the count values above idx as the results of the handle at idx and wakes its waiters
+static void complete_handle(lua_State* L, const int idx, const int count)
+{
+    TaskHandle* handle = lua_touserdata(L, idx);
+    handle->done = true;
+
+    lua_getfenv(L, idx);
+    for (int i = 1; i <= count; ++i)
+    {
+        lua_pushvalue(L, idx + i);
+        lua_rawseti(L, -2, i);
+    }
+    lua_pushinteger(L, count);
+    lua_setfield(L, -2, "n");
+    lua_pop(L, 1);
+
+    // waiters pick the results up when they resume on the next pass
+    for (int waiter = handle->first_waiter; waiter != -1; waiter = tasks[waiter].next_waiter)
+        timer_push(&frame_timers, frame_number, waiter);
+
+    handle->first_waiter = -1;
+    handle->last_waiter = -1;
+}
+
+static void push_new_handle(lua_State* L)
+{
+    TaskHandle* handle = lua_newuserdata(L, sizeof(TaskHandle));
+    handle->done = false;
+    handle->first_waiter = -1;
+    handle->last_waiter = -1;
+
+    luaL_getmetatable(L, "__mt_task_handle");
+    lua_setmetatable(L, -2);
+
+    lua_newtable(L);
+    lua_setfenv(L, -2);
+}
+
+static void resume_task(lua_State* L, const int index, const int nargs)
+{
+    lua_State* thread = tasks[index].thread;
+    const int previous = current_task;
+
+    current_task = index;
+    tasks[index].parked = false;
+    const int status = lua_resume(thread, nargs);
+    current_task = previous;
+
+    // spawning from inside the task may have moved the task array
+    Task* task = &tasks[index];
+
+    if (status == LUA_YIELD)
+    {
+        lua_settop(thread, 0);
+        if (!task->parked)
+            timer_push(&frame_timers, frame_number + 1, index);
+        return;
+    }
+
+    if (status != 0)
+    {
+        printf("Lua error in task: %s\n", lua_tostring(thread, -1));
+        lua_settop(thread, 0);
+    }
+
+    // whatever the task function returned becomes the result of its handle
+    const int count = lua_gettop(thread);
+    luaL_checkstack(L, count + 1, "too many results");
+    lua_rawgeti(L, LUA_REGISTRYINDEX, task->handle_ref);
+    const int handle_idx = lua_gettop(L);
+    lua_xmove(thread, L, count);
+    complete_handle(L, handle_idx, count);
+    lua_settop(L, handle_idx - 1);
+
+    task_free(L, index);
+}
+
+static void run_timers(lua_State* L, TimerHeap* heap, const double now, const unsigned int barrier)
+{
+    // timers scheduled during this pass wait for the next one, so a task cannot starve the frame
+    while (heap->count > 0 && heap->timers[0].wake <= now && heap->timers[0].sequence < barrier)
+    {
+        const Timer timer = timer_pop(heap);
+        Task* task = &tasks[timer.task];
+        if (!task->alive)
+            continue;
+
+        int nargs = 0;
+        if (task->wait_ref != LUA_NOREF)
+        {
+            lua_rawgeti(L, LUA_REGISTRYINDEX, task->wait_ref);
+            nargs = push_handle_results(L, lua_gettop(L), task->thread);
+            lua_pop(L, 1);
+
+            luaL_unref(L, LUA_REGISTRYINDEX, task->wait_ref);
+            task->wait_ref = LUA_NOREF;
+        }
+
+        resume_task(L, timer.task, nargs);
+    }
+}
+
+void scheduler_update(lua_State* L, const float dt)
+{
+    frame_number += 1;
+    elapsed += dt;
+
+    const unsigned int barrier = next_sequence;
+    run_timers(L, &frame_timers, frame_number, barrier);
+    run_timers(L, &time_timers, elapsed, barrier);
+}
+
+double scheduler_next_wake(void)
+{
+    // frame waits need the very next frame, time waits only once their time has come
+    if (frame_timers.count > 0)
+        return 0;
+
+    if (time_timers.count > 0)
+    {
+        const double remaining = time_timers.timers[0].wake - elapsed;
+        return remaining > 0 ? remaining : 0;
+    }
+
+    return -1;
+}
+
+void scheduler_reset(void)
+{
+    free(tasks);
+    free(frame_timers.timers);
+    free(time_timers.timers);
+
+    tasks = NULL;
+    task_capacity = 0;
+    task_used = 0;
+    live_tasks = 0;
+    free_task = -1;
+    current_task = -1;
+
+    frame_timers = (TimerHeap){0};
+    time_timers = (TimerHeap){0};
+    next_sequence = 0;
+    frame_number = 0;
+    elapsed = 0;
+}
+
+// MARK: Lua Functions
+
+static int cmt_spawn(lua_State* L)
+{
+    luaL_checktype(L, 1, LUA_TFUNCTION);
+    const int argc = lua_gettop(L) - 1;
+    const int index = task_allocate();
+
+    lua_State* thread = lua_newthread(L);
+    tasks[index].thread = thread;
+    tasks[index].thread_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+
+    push_new_handle(L);
+    lua_pushvalue(L, -1);
+    tasks[index].handle_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+
+    // the function and its arguments move onto the new thread
+    lua_checkstack(thread, argc + 1);
+    for (int i = 1; i <= argc + 1; ++i)
+        lua_pushvalue(L, i);
+    lua_xmove(L, thread, argc + 1);
+
+    // the task runs straight away up to its first wait
+    resume_task(L, index, argc);
+    return 1;
+}
+
+static int cmt_wait_frames(lua_State* L)
+{
+    const lua_Integer frames = luaL_optinteger(L, 1, 1);
+    const int index = check_current_task(L, "wait_frames");
+
+    timer_push(&frame_timers, frame_number + (frames < 1 ? 1 : frames), index);
+    tasks[index].parked = true;
+    return lua_yield(L, 0);
+}
+
+static int cmt_wait_seconds(lua_State* L)
+{
+    const lua_Number seconds = luaL_checknumber(L, 1);
+    const int index = check_current_task(L, "wait_seconds");
+
+    timer_push(&time_timers, elapsed + (seconds > 0 ? seconds : 0), index);
+    tasks[index].parked = true;
+    return lua_yield(L, 0);
+}
+
+static int cmt_wait(lua_State* L)
+{
+    TaskHandle* handle = luaL_checkudata(L, 1, "__mt_task_handle");
+    if (handle->done)
+        return push_handle_results(L, 1, L);
+
+    const int index = check_current_task(L, "wait");
+    lua_pushvalue(L, 1);
+    tasks[index].wait_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+
+    // waiters are woken in the order they started waiting
+    tasks[index].next_waiter = -1;
+    if (handle->last_waiter == -1)
+        handle->first_waiter = index;
+    else
+        tasks[handle->last_waiter].next_waiter = index;
+    handle->last_waiter = index;
+
+    tasks[index].parked = true;
+    return lua_yield(L, 0);
+}
+
+static int cmt_handle_new(lua_State* L)
+{
+    push_new_handle(L);
+    return 1;
+}
+
+static int cmt_handle_complete(lua_State* L)
+{
+    const TaskHandle* handle = luaL_checkudata(L, 1, "__mt_task_handle");
+    if (handle->done)
+        return luaL_error(L, "handle is already complete");
+
+    complete_handle(L, 1, lua_gettop(L) - 1);
+    return 0;
+}
+
+static int cmt_task_count(lua_State* L)
+{
+    lua_pushinteger(L, live_tasks);
+    return 1;
+}
+
+static int cmt_handle_index(lua_State* L)
+{
+    const TaskHandle* handle = luaL_checkudata(L, 1, "__mt_task_handle");
+    const char* key = luaL_checkstring(L, 2);
+
+    if (strcmp(key, "done") == 0)
+    {
+        lua_pushboolean(L, handle->done);
+    }
+    else
+    {
+        return luaL_error(L, "Handle has no field \"%s\".", key);
+    }
+
+    return 1;
+}
+
+void register_scheduler_bindings(lua_State* L)
+{
+    lua_register(L, "spawn", cmt_spawn);
+    lua_register(L, "wait_frames", cmt_wait_frames);
+    lua_register(L, "wait_seconds", cmt_wait_seconds);
+    lua_register(L, "wait", cmt_wait);
+    lua_register(L, "handle_new", cmt_handle_new);
+    lua_register(L, "handle_complete", cmt_handle_complete);
+    lua_register(L, "task_count", cmt_task_count);
+
+    if (!luaL_newmetatable(L, "__mt_task_handle"))
+        printf("Lua error: Handle metatable at __mt_task_handle already exists\n");
+
+    lua_pushcfunction(L, cmt_handle_index);
+    lua_setfield(L, -2, "__index");
+    lua_pop(L, 1);
+}
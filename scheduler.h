@@ -0,0 +1,55 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include "comet.h"
+
+typedef struct Task
+{
+    lua_State* thread;
+    int thread_ref;
+    int handle_ref;
+
+    // handle this task is blocked on, LUA_NOREF when it is not waiting for one
+    int wait_ref;
+    int next_waiter;
+
+    // set when the task yielded with a wake condition, a bare yield resumes on the next frame
+    bool parked;
+    bool alive;
+    int next_free;
+} Task;
+
+// completion state shared by tasks and manually completed handles, the results live in its environment table
+typedef struct TaskHandle
+{
+    bool done;
+    int first_waiter;
+    int last_waiter;
+} TaskHandle;
+
+typedef struct Timer
+{
+    double wake;
+    unsigned int sequence;
+    int task;
+} Timer;
+
+typedef struct TimerHeap
+{
+    Timer* timers;
+    int count;
+    int capacity;
+} TimerHeap;
+
+// resumes every task whose wait has finished
+void scheduler_update(lua_State* L, float dt);
+
+// seconds of scheduler time until the next sleeping task wakes, or -1 when none is sleeping
+double scheduler_next_wake(void);
+
+// drops all tasks, used when the Lua state they belong to is closed
+void scheduler_reset(void);
+
+void register_scheduler_bindings(lua_State* L);
+
+#endif //SCHEDULER_H
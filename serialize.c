@@ -0,0 +1,593 @@
+#include "serialize.h"
+#include "bindings.h"
+#include "entity.h"
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SERIAL_VERSION 1
+
+static const unsigned char serial_magic[3] = {'C', 'M', 'T'};
+
+enum
+{
+    SERIAL_NIL,
+    SERIAL_FALSE,
+    SERIAL_TRUE,
+    SERIAL_INTEGER,
+    SERIAL_NUMBER,
+    SERIAL_STRING,
+    SERIAL_TABLE,
+    SERIAL_TABLE_END,
+    SERIAL_REFERENCE,
+    SERIAL_RECT,
+    SERIAL_COLOR,
+    SERIAL_CAMERA,
+    SERIAL_ENTITY
+};
+
+// engine userdata types in the order their metatables are kept on the stack
+#define USERDATA_TYPE_COUNT 4
+static const char* userdata_metatables[USERDATA_TYPE_COUNT] = {"__mt_rect", "__mt_color", "__mt_camera", "__mt_entity"};
+
+// reused by the Lua serialize function so repeated saves do not grow the heap again
+static SerialBuffer arena = {0};
+
+// MARK: Buffer
+
+void serial_buffer_clear(SerialBuffer* buffer)
+{
+    buffer->size = 0;
+}
+
+void serial_buffer_free(SerialBuffer* buffer)
+{
+    free(buffer->data);
+    buffer->data = NULL;
+    buffer->size = 0;
+    buffer->capacity = 0;
+}
+
+unsigned char* serial_buffer_reserve(SerialBuffer* buffer, const size_t size)
+{
+    if (buffer->size + size > buffer->capacity)
+    {
+        size_t capacity = buffer->capacity == 0 ? 4096 : buffer->capacity;
+        while (buffer->size + size > capacity)
+            capacity *= 2;
+
+        buffer->data = realloc(buffer->data, capacity);
+        buffer->capacity = capacity;
+    }
+
+    return buffer->data + buffer->size;
+}
+
+void serial_buffer_write(SerialBuffer* buffer, const void* data, const size_t size)
+{
+    memcpy(serial_buffer_reserve(buffer, size), data, size);
+    buffer->size += size;
+}
+
+static void write_tag(SerialBuffer* buffer, const unsigned char tag)
+{
+    *serial_buffer_reserve(buffer, 1) = tag;
+    buffer->size++;
+}
+
+void serial_buffer_write_varint(SerialBuffer* buffer, uint64_t value)
+{
+    unsigned char* out = serial_buffer_reserve(buffer, 10);
+    unsigned char* start = out;
+    while (value >= 0x80)
+    {
+        *out++ = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    *out++ = (unsigned char)value;
+    buffer->size += out - start;
+}
+
+static void write_tagged_varint(SerialBuffer* buffer, const unsigned char tag, const uint64_t value)
+{
+    write_tag(buffer, tag);
+    serial_buffer_write_varint(buffer, value);
+}
+
+// MARK: Encoding
+
+typedef struct Serializer
+{
+    SerialBuffer* buffer;
+
+    // stack index of the table mapping tables, strings and userdata to the id of their first occurrence
+    int seen;
+    int metatables;
+    unsigned int next_id;
+} Serializer;
+
+// writes a reference when the object at idx was written before, otherwise gives it the next id
+static bool write_reference(lua_State* L, Serializer* serializer, const int idx)
+{
+    lua_pushvalue(L, idx);
+    lua_rawget(L, serializer->seen);
+    if (!lua_isnil(L, -1))
+    {
+        write_tagged_varint(serializer->buffer, SERIAL_REFERENCE, (uint64_t)lua_tonumber(L, -1));
+        lua_pop(L, 1);
+        return true;
+    }
+    lua_pop(L, 1);
+
+    lua_pushvalue(L, idx);
+    lua_pushnumber(L, serializer->next_id++);
+    lua_rawset(L, serializer->seen);
+    return false;
+}
+
+static int userdata_type(lua_State* L, const Serializer* serializer, const int idx)
+{
+    if (!lua_getmetatable(L, idx))
+        return -1;
+
+    for (int i = 0; i < USERDATA_TYPE_COUNT; ++i)
+    {
+        if (lua_rawequal(L, -1, serializer->metatables + i))
+        {
+            lua_pop(L, 1);
+            return i;
+        }
+    }
+
+    lua_pop(L, 1);
+    return -1;
+}
+
+static void write_number(SerialBuffer* buffer, const lua_Number number)
+{
+    // integral values are far more common than fractions and take one or two bytes as a zigzag varint
+    if (number == floor(number) && fabs(number) < 9007199254740992.0 && !(number == 0 && signbit(number)))
+    {
+        const int64_t integer = (int64_t)number;
+        write_tagged_varint(buffer, SERIAL_INTEGER, ((uint64_t)integer << 1) ^ (uint64_t)(integer >> 63));
+        return;
+    }
+
+    write_tag(buffer, SERIAL_NUMBER);
+    serial_buffer_write(buffer, &number, sizeof(number));
+}
+
+static const char* encode_value(lua_State* L, Serializer* serializer, const int idx, const int depth)
+{
+    SerialBuffer* buffer = serializer->buffer;
+    if (depth > SERIALIZE_MAX_DEPTH)
+        return "value is nested too deeply";
+
+    switch (lua_type(L, idx))
+    {
+    case LUA_TNIL:
+        write_tag(buffer, SERIAL_NIL);
+        break;
+    case LUA_TBOOLEAN:
+        write_tag(buffer, lua_toboolean(L, idx) ? SERIAL_TRUE : SERIAL_FALSE);
+        break;
+    case LUA_TNUMBER:
+        write_number(buffer, lua_tonumber(L, idx));
+        break;
+    case LUA_TSTRING:
+        {
+            if (write_reference(L, serializer, idx))
+                break;
+
+            size_t length = 0;
+            const char* str = lua_tolstring(L, idx, &length);
+            write_tagged_varint(buffer, SERIAL_STRING, length);
+            serial_buffer_write(buffer, str, length);
+            break;
+        }
+    case LUA_TTABLE:
+        {
+            if (write_reference(L, serializer, idx))
+                break;
+
+            if (!lua_checkstack(L, 4))
+                return "value is nested too deeply";
+
+            // the array part goes first without keys, the rest as key value pairs
+            const int length = (int)lua_objlen(L, idx);
+            write_tagged_varint(buffer, SERIAL_TABLE, length);
+
+            for (int i = 1; i <= length; ++i)
+            {
+                lua_rawgeti(L, idx, i);
+                const char* error = encode_value(L, serializer, lua_gettop(L), depth + 1);
+                if (error != NULL)
+                    return error;
+                lua_pop(L, 1);
+            }
+
+            lua_pushnil(L);
+            while (lua_next(L, idx))
+            {
+                const int top = lua_gettop(L);
+                if (lua_type(L, top - 1) == LUA_TNUMBER)
+                {
+                    const lua_Number key = lua_tonumber(L, top - 1);
+                    if (key >= 1 && key <= length && key == floor(key))
+                    {
+                        lua_pop(L, 1);
+                        continue;
+                    }
+                }
+
+                const char* error = encode_value(L, serializer, top - 1, depth + 1);
+                if (error == NULL)
+                    error = encode_value(L, serializer, top, depth + 1);
+                if (error != NULL)
+                    return error;
+
+                lua_pop(L, 1);
+            }
+
+            write_tag(buffer, SERIAL_TABLE_END);
+            break;
+        }
+    case LUA_TUSERDATA:
+        {
+            const int type = userdata_type(L, serializer, idx);
+            if (type == -1)
+                return "only Rect, Color, Camera and Entity userdata can be serialized";
+
+            if (write_reference(L, serializer, idx))
+                break;
+
+            const void* data = lua_touserdata(L, idx);
+            if (type == 0)
+            {
+                write_tag(buffer, SERIAL_RECT);
+                serial_buffer_write(buffer, data, sizeof(Rectangle));
+            }
+            else if (type == 1)
+            {
+                write_tag(buffer, SERIAL_COLOR);
+                serial_buffer_write(buffer, data, sizeof(Color));
+            }
+            else if (type == 2)
+            {
+                write_tag(buffer, SERIAL_CAMERA);
+                serial_buffer_write(buffer, data, sizeof(Camera2D));
+            }
+            else
+            {
+                // only the handle is written, it resolves to whatever entity the store holds when decoded
+                write_tagged_varint(buffer, SERIAL_ENTITY, *(const EntityHandle*)data);
+            }
+            break;
+        }
+    default:
+        return "only nil, booleans, numbers, strings, tables and engine userdata can be serialized";
+    }
+
+    return NULL;
+}
+
+const char* serialize_value(lua_State* L, int idx, SerialBuffer* buffer)
+{
+    if (idx < 0)
+        idx = lua_gettop(L) + idx + 1;
+
+    const int top = lua_gettop(L);
+    if (!lua_checkstack(L, 8))
+        return "not enough stack space to serialize";
+
+    Serializer serializer = {buffer, 0, 0, 0};
+
+    lua_newtable(L);
+    serializer.seen = lua_gettop(L);
+
+    serializer.metatables = lua_gettop(L) + 1;
+    for (int i = 0; i < USERDATA_TYPE_COUNT; ++i)
+        luaL_getmetatable(L, userdata_metatables[i]);
+
+    serial_buffer_write(buffer, serial_magic, sizeof(serial_magic));
+    write_tag(buffer, SERIAL_VERSION);
+
+    const char* error = encode_value(L, &serializer, idx, 0);
+
+    lua_settop(L, top);
+    return error;
+}
+
+// MARK: Decoding
+
+typedef struct Deserializer
+{
+    const unsigned char* cur;
+    const unsigned char* end;
+
+    // stack index of the table mapping ids back to objects
+    int objects;
+    int next_id;
+
+    // engine metatables are missing in worker states, userdata then decode as plain tables
+    bool engine_types;
+} Deserializer;
+
+static bool read_varint(Deserializer* reader, uint64_t* value)
+{
+    uint64_t result = 0;
+    for (int shift = 0; shift < 64 && reader->cur < reader->end; shift += 7)
+    {
+        const unsigned char byte = *reader->cur++;
+        result |= (uint64_t)(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0)
+        {
+            *value = result;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool read_bytes(Deserializer* reader, void* out, const size_t size)
+{
+    if ((size_t)(reader->end - reader->cur) < size)
+        return false;
+
+    memcpy(out, reader->cur, size);
+    reader->cur += size;
+    return true;
+}
+
+static void remember_object(lua_State* L, Deserializer* reader)
+{
+    lua_pushvalue(L, -1);
+    lua_rawseti(L, reader->objects, ++reader->next_id);
+}
+
+static void push_fields(lua_State* L, const char** names, const float* values, const int count)
+{
+    lua_createtable(L, 0, count);
+    for (int i = 0; i < count; ++i)
+    {
+        lua_pushnumber(L, values[i]);
+        lua_setfield(L, -2, names[i]);
+    }
+}
+
+static bool decode_value(lua_State* L, Deserializer* reader, const int depth)
+{
+    if (reader->cur >= reader->end || depth > SERIALIZE_MAX_DEPTH || !lua_checkstack(L, 4))
+        return false;
+
+    const unsigned char tag = *reader->cur++;
+    switch (tag)
+    {
+    case SERIAL_NIL:
+        lua_pushnil(L);
+        return true;
+    case SERIAL_FALSE:
+        lua_pushboolean(L, false);
+        return true;
+    case SERIAL_TRUE:
+        lua_pushboolean(L, true);
+        return true;
+    case SERIAL_INTEGER:
+        {
+            uint64_t zigzag;
+            if (!read_varint(reader, &zigzag))
+                return false;
+
+            const int64_t integer = (int64_t)(zigzag >> 1) ^ -(int64_t)(zigzag & 1);
+            lua_pushnumber(L, (lua_Number)integer);
+            return true;
+        }
+    case SERIAL_NUMBER:
+        {
+            lua_Number number;
+            if (!read_bytes(reader, &number, sizeof(number)))
+                return false;
+
+            lua_pushnumber(L, number);
+            return true;
+        }
+    case SERIAL_STRING:
+        {
+            uint64_t length;
+            if (!read_varint(reader, &length) || (uint64_t)(reader->end - reader->cur) < length)
+                return false;
+
+            lua_pushlstring(L, (const char*)reader->cur, length);
+            reader->cur += length;
+            remember_object(L, reader);
+            return true;
+        }
+    case SERIAL_REFERENCE:
+        {
+            uint64_t id;
+            if (!read_varint(reader, &id) || id >= (uint64_t)reader->next_id)
+                return false;
+
+            lua_rawgeti(L, reader->objects, (int)id + 1);
+            return true;
+        }
+    case SERIAL_TABLE:
+        {
+            uint64_t length;
+            if (!read_varint(reader, &length) || length > (uint64_t)(reader->end - reader->cur))
+                return false;
+
+            // registered before the contents so cycles resolve to the table being built
+            lua_createtable(L, (int)length, 0);
+            remember_object(L, reader);
+            const int table = lua_gettop(L);
+
+            for (int i = 1; i <= (int)length; ++i)
+            {
+                if (!decode_value(L, reader, depth + 1))
+                    return false;
+                lua_rawseti(L, table, i);
+            }
+
+            while (reader->cur < reader->end && *reader->cur != SERIAL_TABLE_END)
+            {
+                if (!decode_value(L, reader, depth + 1) || !decode_value(L, reader, depth + 1))
+                    return false;
+
+                // a nil or NaN key can only come from corrupted data
+                if (lua_isnil(L, -2) || (lua_type(L, -2) == LUA_TNUMBER && lua_tonumber(L, -2) != lua_tonumber(L, -2)))
+                    return false;
+
+                lua_rawset(L, table);
+            }
+
+            if (reader->cur >= reader->end)
+                return false;
+
+            reader->cur++;
+            return true;
+        }
+    case SERIAL_RECT:
+        {
+            Rectangle rect;
+            if (!read_bytes(reader, &rect, sizeof(rect)))
+                return false;
+
+            if (reader->engine_types)
+            {
+                cmt_rect_new_internal(L, rect.x, rect.y, rect.width, rect.height);
+            }
+            else
+            {
+                const char* names[] = {"x", "y", "width", "height"};
+                const float values[] = {rect.x, rect.y, rect.width, rect.height};
+                push_fields(L, names, values, 4);
+            }
+
+            remember_object(L, reader);
+            return true;
+        }
+    case SERIAL_COLOR:
+        {
+            Color color;
+            if (!read_bytes(reader, &color, sizeof(color)))
+                return false;
+
+            if (reader->engine_types)
+            {
+                cmt_color_new_internal(L, color.r, color.g, color.b, color.a);
+            }
+            else
+            {
+                const char* names[] = {"r", "g", "b", "a"};
+                const float values[] = {color.r, color.g, color.b, color.a};
+                push_fields(L, names, values, 4);
+            }
+
+            remember_object(L, reader);
+            return true;
+        }
+    case SERIAL_CAMERA:
+        {
+            Camera2D camera;
+            if (!read_bytes(reader, &camera, sizeof(camera)))
+                return false;
+
+            if (reader->engine_types)
+            {
+                Camera2D* cam_ptr = cmt_camera_new_internal(L, 0, 0, 0, 1);
+                *cam_ptr = camera;
+            }
+            else
+            {
+                const char* names[] = {"x", "y", "rotation", "zoom"};
+                const float values[] = {-camera.offset.x, -camera.offset.y, camera.rotation, camera.zoom};
+                push_fields(L, names, values, 4);
+            }
+
+            remember_object(L, reader);
+            return true;
+        }
+    case SERIAL_ENTITY:
+        {
+            uint64_t handle;
+            if (!read_varint(reader, &handle) || handle > UINT32_MAX)
+                return false;
+
+            if (reader->engine_types)
+            {
+                entity_push_handle(L, (EntityHandle)handle);
+            }
+            else
+            {
+                lua_createtable(L, 0, 1);
+                lua_pushnumber(L, (lua_Number)handle);
+                lua_setfield(L, -2, "handle");
+            }
+
+            remember_object(L, reader);
+            return true;
+        }
+    default:
+        return false;
+    }
+}
+
+bool deserialize_value(lua_State* L, const unsigned char* data, const size_t size)
+{
+    const int top = lua_gettop(L);
+    if (size < sizeof(serial_magic) + 1 || memcmp(data, serial_magic, sizeof(serial_magic)) != 0 ||
+        data[sizeof(serial_magic)] != SERIAL_VERSION || !lua_checkstack(L, 8))
+        return false;
+
+    luaL_getmetatable(L, userdata_metatables[0]);
+    const bool engine_types = !lua_isnil(L, -1);
+    lua_pop(L, 1);
+
+    lua_newtable(L);
+    Deserializer reader = {data + sizeof(serial_magic) + 1, data + size, lua_gettop(L), 0, engine_types};
+
+    if (!decode_value(L, &reader, 0) || reader.cur != reader.end)
+    {
+        lua_settop(L, top);
+        return false;
+    }
+
+    // drop the object table from under the result
+    lua_remove(L, top + 1);
+    return true;
+}
+
+// MARK: Lua Functions
+
+static int cmt_serialize(lua_State* L)
+{
+    luaL_checkany(L, 1);
+    lua_settop(L, 1);
+
+    serial_buffer_clear(&arena);
+    const char* error = serialize_value(L, 1, &arena);
+    if (error != NULL)
+        return luaL_error(L, "serialize failed: %s", error);
+
+    lua_pushlstring(L, (const char*)arena.data, arena.size);
+    return 1;
+}
+
+static int cmt_deserialize(lua_State* L)
+{
+    size_t size = 0;
+    const char* data = luaL_checklstring(L, 1, &size);
+
+    if (!deserialize_value(L, (const unsigned char*)data, size))
+        return luaL_error(L, "deserialize was given data that is not a serialized value");
+
+    return 1;
+}
+
+void register_serialize_bindings(lua_State* L)
+{
+    lua_register(L, "serialize", cmt_serialize);
+    lua_register(L, "deserialize", cmt_deserialize);
+}
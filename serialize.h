@@ -0,0 +1,32 @@
+#ifndef SERIALIZE_H
+#define SERIALIZE_H
+
+#include <stdint.h>
+#include "comet.h"
+
+#define SERIALIZE_MAX_DEPTH 200
+
+// growable output buffer, clearing it keeps the memory for the next value
+typedef struct SerialBuffer
+{
+    unsigned char* data;
+    size_t size;
+    size_t capacity;
+} SerialBuffer;
+
+// returns space for size more bytes at the end of the buffer without changing its size
+unsigned char* serial_buffer_reserve(SerialBuffer* buffer, size_t size);
+void serial_buffer_write(SerialBuffer* buffer, const void* data, size_t size);
+void serial_buffer_write_varint(SerialBuffer* buffer, uint64_t value);
+void serial_buffer_clear(SerialBuffer* buffer);
+void serial_buffer_free(SerialBuffer* buffer);
+
+// appends the value at idx, returns an error message instead of raising so callers can clean up first
+const char* serialize_value(lua_State* L, int idx, SerialBuffer* buffer);
+
+// pushes the decoded value, returns false and leaves the stack unchanged when the data is malformed
+bool deserialize_value(lua_State* L, const unsigned char* data, size_t size);
+
+void register_serialize_bindings(lua_State* L);
+
+#endif //SERIALIZE_H
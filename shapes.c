@@ -0,0 +1,338 @@
+#include "shapes.h"
+#include "bindings.h"
+#include "rlgl.h"
+#include <math.h>
+
+// MARK: Batch
+
+// shapes of one call share a single rlgl mode, the batch is only reopened when it fills up
+static int batch_mode = RL_TRIANGLES;
+static int batch_used = -1;
+static Color batch_color;
+
+static void batch_begin(const int mode, const Color color)
+{
+    batch_mode = mode;
+    batch_color = color;
+    batch_used = -1;
+}
+
+static void batch_reserve(const int vertices)
+{
+    if (batch_used >= 0 && batch_used + vertices > SHAPES_BATCH_VERTICES)
+    {
+        rlEnd();
+        batch_used = -1;
+    }
+
+    if (batch_used < 0)
+    {
+        rlCheckRenderBatchLimit(SHAPES_BATCH_VERTICES);
+        rlBegin(batch_mode);
+        rlColor4ub(batch_color.r, batch_color.g, batch_color.b, batch_color.a);
+        batch_used = 0;
+    }
+
+    batch_used += vertices;
+}
+
+static void batch_end(void)
+{
+    if (batch_used >= 0)
+        rlEnd();
+    batch_used = -1;
+}
+
+// MARK: Emitters
+
+static void emit_quad(const float x0, const float y0, const float x1, const float y1,
+                      const float x2, const float y2, const float x3, const float y3)
+{
+    batch_reserve(6);
+    rlVertex2f(x0, y0);
+    rlVertex2f(x1, y1);
+    rlVertex2f(x2, y2);
+
+    rlVertex2f(x0, y0);
+    rlVertex2f(x2, y2);
+    rlVertex2f(x3, y3);
+}
+
+static void emit_rect(const float x, const float y, const float width, const float height)
+{
+    emit_quad(x, y, x, y + height, x + width, y + height, x + width, y);
+}
+
+static void emit_rect_lines(const float x, const float y, const float width, const float height, const float thickness)
+{
+    // top and bottom span the full width, the sides fill the gap between them
+    emit_rect(x, y, width, thickness);
+    emit_rect(x, y + height - thickness, width, thickness);
+    emit_rect(x, y + thickness, thickness, height - 2.0f * thickness);
+    emit_rect(x + width - thickness, y + thickness, thickness, height - 2.0f * thickness);
+}
+
+static void emit_thick_line(const float x0, const float y0, const float x1, const float y1, const float thickness)
+{
+    const float dx = x1 - x0;
+    const float dy = y1 - y0;
+    const float length = sqrtf(dx * dx + dy * dy);
+    if (length <= 0.0f)
+        return;
+
+    const float nx = -dy / length * thickness * 0.5f;
+    const float ny = dx / length * thickness * 0.5f;
+    emit_quad(x0 - nx, y0 - ny, x0 + nx, y0 + ny, x1 + nx, y1 + ny, x1 - nx, y1 - ny);
+}
+
+static void emit_line(const float x0, const float y0, const float x1, const float y1)
+{
+    batch_reserve(2);
+    rlVertex2f(x0, y0);
+    rlVertex2f(x1, y1);
+}
+
+static void emit_circle(const float x, const float y, const float radius, const int segments)
+{
+    const float step = 2.0f * PI / (float)segments;
+    batch_reserve(segments * 3);
+
+    float previous_x = x + radius;
+    float previous_y = y;
+    for (int i = 1; i <= segments; ++i)
+    {
+        const float next_x = x + cosf(step * (float)i) * radius;
+        const float next_y = y + sinf(step * (float)i) * radius;
+
+        // counter clockwise on screen so the triangles survive back face culling
+        rlVertex2f(x, y);
+        rlVertex2f(next_x, next_y);
+        rlVertex2f(previous_x, previous_y);
+
+        previous_x = next_x;
+        previous_y = next_y;
+    }
+}
+
+// MARK: Argument Helpers
+
+static int check_segments(lua_State* L, const int idx)
+{
+    const int segments = (int)luaL_optinteger(L, idx, SHAPES_DEFAULT_CIRCLE_SEGMENTS);
+    luaL_argcheck(L, segments >= 3 && segments <= SHAPES_MAX_CIRCLE_SEGMENTS, idx, "segment count is out of range");
+    return segments;
+}
+
+// packed arrays are flat lists of numbers, stride values per shape
+static int check_packed(lua_State* L, const int idx, const int stride)
+{
+    luaL_checktype(L, idx, LUA_TTABLE);
+    const int length = (int)lua_objlen(L, idx);
+    if (length % stride != 0)
+        return luaL_argerror(L, idx, lua_pushfstring(L, "packed array length must be a multiple of %d", stride));
+    return length / stride;
+}
+
+static void read_packed(lua_State* L, const int idx, const int first, const int stride, float* values)
+{
+    for (int i = 0; i < stride; ++i)
+    {
+        lua_rawgeti(L, idx, first + i);
+        values[i] = (float)lua_tonumber(L, -1);
+        lua_pop(L, 1);
+    }
+}
+
+// MARK: Lua Functions
+
+static int cmt_shape_rect(lua_State* L)
+{
+    const lua_Number x = luaL_checknumber(L, 1);
+    const lua_Number y = luaL_checknumber(L, 2);
+    const lua_Number width = luaL_checknumber(L, 3);
+    const lua_Number height = luaL_checknumber(L, 4);
+    const Color* color = cmt_check_color(L, 5, "color");
+
+    batch_begin(RL_TRIANGLES, *color);
+    emit_rect((float)x, (float)y, (float)width, (float)height);
+    batch_end();
+    return 0;
+}
+
+static int cmt_shape_rect_lines(lua_State* L)
+{
+    const lua_Number x = luaL_checknumber(L, 1);
+    const lua_Number y = luaL_checknumber(L, 2);
+    const lua_Number width = luaL_checknumber(L, 3);
+    const lua_Number height = luaL_checknumber(L, 4);
+    const Color* color = cmt_check_color(L, 5, "color");
+    const lua_Number thickness = luaL_optnumber(L, 6, 1.0);
+
+    batch_begin(RL_TRIANGLES, *color);
+    emit_rect_lines((float)x, (float)y, (float)width, (float)height, (float)thickness);
+    batch_end();
+    return 0;
+}
+
+static int cmt_shape_line(lua_State* L)
+{
+    const lua_Number x0 = luaL_checknumber(L, 1);
+    const lua_Number y0 = luaL_checknumber(L, 2);
+    const lua_Number x1 = luaL_checknumber(L, 3);
+    const lua_Number y1 = luaL_checknumber(L, 4);
+    const Color* color = cmt_check_color(L, 5, "color");
+
+    if (lua_isnoneornil(L, 6))
+    {
+        batch_begin(RL_LINES, *color);
+        emit_line((float)x0, (float)y0, (float)x1, (float)y1);
+    }
+    else
+    {
+        batch_begin(RL_TRIANGLES, *color);
+        emit_thick_line((float)x0, (float)y0, (float)x1, (float)y1, (float)luaL_checknumber(L, 6));
+    }
+
+    batch_end();
+    return 0;
+}
+
+static int cmt_shape_circle(lua_State* L)
+{
+    const lua_Number x = luaL_checknumber(L, 1);
+    const lua_Number y = luaL_checknumber(L, 2);
+    const lua_Number radius = luaL_checknumber(L, 3);
+    const Color* color = cmt_check_color(L, 4, "color");
+    const int segments = check_segments(L, 5);
+
+    batch_begin(RL_TRIANGLES, *color);
+    emit_circle((float)x, (float)y, (float)radius, segments);
+    batch_end();
+    return 0;
+}
+
+static int cmt_shape_polygon(lua_State* L)
+{
+    const int count = check_packed(L, 1, 2);
+    const Color* color = cmt_check_color(L, 2, "color");
+    luaL_argcheck(L, count >= 3, 1, "a polygon needs at least three points");
+
+    float first[2];
+    float previous[2];
+    float next[2];
+    read_packed(L, 1, 1, 2, first);
+    read_packed(L, 1, 3, 2, previous);
+
+    // convex polygons only, fanned out from the first point
+    batch_begin(RL_TRIANGLES, *color);
+    for (int i = 2; i < count; ++i)
+    {
+        read_packed(L, 1, i * 2 + 1, 2, next);
+
+        // points may come in either order, each triangle is flipped to face the camera
+        const float cross = (previous[0] - first[0]) * (next[1] - first[1]) - (previous[1] - first[1]) * (next[0] - first[0]);
+        batch_reserve(3);
+        rlVertex2f(first[0], first[1]);
+        if (cross < 0.0f)
+        {
+            rlVertex2f(previous[0], previous[1]);
+            rlVertex2f(next[0], next[1]);
+        }
+        else
+        {
+            rlVertex2f(next[0], next[1]);
+            rlVertex2f(previous[0], previous[1]);
+        }
+
+        previous[0] = next[0];
+        previous[1] = next[1];
+    }
+    batch_end();
+    return 0;
+}
+
+static int cmt_shape_rects(lua_State* L)
+{
+    const int count = check_packed(L, 1, 4);
+    const Color* color = cmt_check_color(L, 2, "color");
+
+    float rect[4];
+    batch_begin(RL_TRIANGLES, *color);
+    for (int i = 0; i < count; ++i)
+    {
+        read_packed(L, 1, i * 4 + 1, 4, rect);
+        emit_rect(rect[0], rect[1], rect[2], rect[3]);
+    }
+    batch_end();
+    return 0;
+}
+
+static int cmt_shape_rect_outlines(lua_State* L)
+{
+    const int count = check_packed(L, 1, 4);
+    const Color* color = cmt_check_color(L, 2, "color");
+    const float thickness = (float)luaL_optnumber(L, 3, 1.0);
+
+    float rect[4];
+    batch_begin(RL_TRIANGLES, *color);
+    for (int i = 0; i < count; ++i)
+    {
+        read_packed(L, 1, i * 4 + 1, 4, rect);
+        emit_rect_lines(rect[0], rect[1], rect[2], rect[3], thickness);
+    }
+    batch_end();
+    return 0;
+}
+
+static int cmt_shape_lines(lua_State* L)
+{
+    const int count = check_packed(L, 1, 4);
+    const Color* color = cmt_check_color(L, 2, "color");
+    const bool thick = !lua_isnoneornil(L, 3);
+    const float thickness = (float)luaL_optnumber(L, 3, 1.0);
+
+    float line[4];
+    batch_begin(thick ? RL_TRIANGLES : RL_LINES, *color);
+    for (int i = 0; i < count; ++i)
+    {
+        read_packed(L, 1, i * 4 + 1, 4, line);
+        if (thick)
+            emit_thick_line(line[0], line[1], line[2], line[3], thickness);
+        else
+            emit_line(line[0], line[1], line[2], line[3]);
+    }
+    batch_end();
+    return 0;
+}
+
+static int cmt_shape_circles(lua_State* L)
+{
+    const int count = check_packed(L, 1, 3);
+    const Color* color = cmt_check_color(L, 2, "color");
+    const int segments = check_segments(L, 3);
+
+    float circle[3];
+    batch_begin(RL_TRIANGLES, *color);
+    for (int i = 0; i < count; ++i)
+    {
+        read_packed(L, 1, i * 3 + 1, 3, circle);
+        emit_circle(circle[0], circle[1], circle[2], segments);
+    }
+    batch_end();
+    return 0;
+}
+
+void register_shapes_bindings(lua_State* L)
+{
+    lua_register(L, "shape_rect", cmt_shape_rect);
+    lua_register(L, "shape_rect_lines", cmt_shape_rect_lines);
+    lua_register(L, "shape_line", cmt_shape_line);
+    lua_register(L, "shape_circle", cmt_shape_circle);
+    lua_register(L, "shape_polygon", cmt_shape_polygon);
+
+    // packed variants draw a whole array of shapes in one pass
+    lua_register(L, "shape_rects", cmt_shape_rects);
+    lua_register(L, "shape_rect_outlines", cmt_shape_rect_outlines);
+    lua_register(L, "shape_lines", cmt_shape_lines);
+    lua_register(L, "shape_circles", cmt_shape_circles);
+}
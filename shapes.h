@@ -0,0 +1,14 @@
+#ifndef SHAPES_H
+#define SHAPES_H
+
+#include "comet.h"
+
+// vertices emitted between render batch checks, well below the size of raylib's default batch
+#define SHAPES_BATCH_VERTICES 4096
+
+#define SHAPES_DEFAULT_CIRCLE_SEGMENTS 36
+#define SHAPES_MAX_CIRCLE_SEGMENTS 256
+
+void register_shapes_bindings(lua_State* L);
+
+#endif //SHAPES_H
@@ -0,0 +1,382 @@
+#include "snapshot.h"
+#include "entity.h"
+#include <stdlib.h>
+#include <string.h>
+
+// shorter matching stretches are cheaper to keep inside a literal than to split it
+#define DELTA_MIN_RUN 4
+
+static Snapshot* ring = NULL;
+static int ring_size = SNAPSHOT_DEFAULT_RING_SIZE;
+static int keyframe_interval = SNAPSHOT_DEFAULT_KEYFRAME_INTERVAL;
+static int newest = -1;
+static int stored = 0;
+static int since_keyframe = 0;
+
+// raw state of the newest snapshot, and the state being captured or rebuilt
+static SerialBuffer previous[SNAPSHOT_SECTION_COUNT];
+static SerialBuffer current[SNAPSHOT_SECTION_COUNT];
+
+// images held by the state being captured, swapped into the ring slot it is saved to
+static SerialBuffer captured_images = {0};
+
+// registry reference to the table of registered script tables by name
+static int registered_ref = LUA_NOREF;
+
+// MARK: Delta Compression
+
+static unsigned char base_byte(const SerialBuffer* base, const size_t i)
+{
+    return base != NULL && i < base->size ? base->data[i] : 0;
+}
+
+static bool run_matches(const SerialBuffer* raw, const SerialBuffer* base, const size_t i)
+{
+    if (i + DELTA_MIN_RUN > raw->size)
+        return false;
+
+    for (size_t j = i; j < i + DELTA_MIN_RUN; ++j)
+    {
+        if (raw->data[j] != base_byte(base, j))
+            return false;
+    }
+    return true;
+}
+
+// xors raw against base and stores it as alternating runs of unchanged bytes and literal changes
+static void delta_encode(SerialBuffer* out, const SerialBuffer* raw, const SerialBuffer* base)
+{
+    serial_buffer_clear(out);
+    size_t shared = 0;
+    if (base != NULL)
+        shared = base->size < raw->size ? base->size : raw->size;
+
+    size_t i = 0;
+    while (i < raw->size)
+    {
+        size_t unchanged = i;
+
+        // most of a frame to frame delta is unchanged, so skip those stretches a word at a time
+        while (unchanged + 8 <= shared && memcmp(raw->data + unchanged, base->data + unchanged, 8) == 0)
+            unchanged += 8;
+        while (unchanged < raw->size && raw->data[unchanged] == base_byte(base, unchanged))
+            unchanged++;
+
+        size_t literal = unchanged;
+        while (literal < raw->size && !run_matches(raw, base, literal))
+            literal++;
+
+        serial_buffer_write_varint(out, unchanged - i);
+        serial_buffer_write_varint(out, literal - unchanged);
+
+        unsigned char* bytes = serial_buffer_reserve(out, literal - unchanged);
+        for (size_t j = unchanged; j < literal; ++j)
+            *bytes++ = raw->data[j] ^ base_byte(base, j);
+        out->size += literal - unchanged;
+
+        i = literal;
+    }
+}
+
+static bool read_varint(const unsigned char** cur, const unsigned char* end, uint64_t* value)
+{
+    uint64_t result = 0;
+    for (int shift = 0; shift < 64 && *cur < end; shift += 7)
+    {
+        const unsigned char byte = *(*cur)++;
+        result |= (uint64_t)(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0)
+        {
+            *value = result;
+            return true;
+        }
+    }
+    return false;
+}
+
+// turns the base state held in target into the state the delta was made from
+static bool delta_apply(SerialBuffer* target, const SerialBuffer* delta, const size_t raw_size)
+{
+    if (raw_size > target->size)
+        memset(serial_buffer_reserve(target, raw_size - target->size), 0, raw_size - target->size);
+    target->size = raw_size;
+
+    const unsigned char* cur = delta->data;
+    const unsigned char* end = delta->data + delta->size;
+    size_t i = 0;
+
+    while (cur < end)
+    {
+        uint64_t unchanged;
+        uint64_t literal;
+        if (!read_varint(&cur, end, &unchanged) || !read_varint(&cur, end, &literal))
+            return false;
+
+        i += unchanged;
+        if (i + literal > raw_size || literal > (uint64_t)(end - cur))
+            return false;
+
+        for (size_t j = 0; j < literal; ++j)
+            target->data[i + j] ^= cur[j];
+
+        cur += literal;
+        i += literal;
+    }
+
+    return true;
+}
+
+// MARK: Capture
+
+static void ensure_ring(void)
+{
+    if (ring == NULL)
+        ring = calloc(ring_size, sizeof(Snapshot));
+}
+
+static void free_ring(lua_State* L)
+{
+    if (ring != NULL)
+    {
+        for (int i = 0; i < ring_size; ++i)
+        {
+            for (int s = 0; s < SNAPSHOT_SECTION_COUNT; ++s)
+                serial_buffer_free(&ring[i].delta[s]);
+
+            entity_snapshot_release(L, &ring[i].images);
+            serial_buffer_free(&ring[i].images);
+        }
+    }
+
+    free(ring);
+    ring = NULL;
+    newest = -1;
+    stored = 0;
+    since_keyframe = 0;
+}
+
+static const char* capture(lua_State* L)
+{
+    serial_buffer_clear(&current[SNAPSHOT_NATIVE]);
+    entity_snapshot_save(&current[SNAPSHOT_NATIVE], &captured_images);
+
+    serial_buffer_clear(&current[SNAPSHOT_SCRIPT]);
+    lua_rawgeti(L, LUA_REGISTRYINDEX, registered_ref);
+    const char* error = serialize_value(L, -1, &current[SNAPSHOT_SCRIPT]);
+    lua_pop(L, 1);
+
+    if (error != NULL)
+        entity_snapshot_release(L, &captured_images);
+    return error;
+}
+
+static void swap_sections(void)
+{
+    for (int s = 0; s < SNAPSHOT_SECTION_COUNT; ++s)
+    {
+        const SerialBuffer buffer = previous[s];
+        previous[s] = current[s];
+        current[s] = buffer;
+    }
+}
+
+// registered tables keep their identity, only their contents are replaced by the saved ones
+static void restore_script_tables(lua_State* L, const int saved)
+{
+    lua_rawgeti(L, LUA_REGISTRYINDEX, registered_ref);
+    const int registered = lua_gettop(L);
+
+    lua_pushnil(L);
+    while (lua_next(L, registered))
+    {
+        const int target = lua_gettop(L);
+        lua_pushvalue(L, -2);
+        lua_rawget(L, saved);
+        const int source = lua_gettop(L);
+
+        // tables registered after the snapshot was taken are left alone
+        if (lua_istable(L, source))
+        {
+            lua_pushnil(L);
+            while (lua_next(L, target))
+            {
+                lua_pop(L, 1);
+                lua_pushvalue(L, -1);
+                lua_pushnil(L);
+                lua_rawset(L, target);
+            }
+
+            lua_pushnil(L);
+            while (lua_next(L, source))
+            {
+                lua_pushvalue(L, -2);
+                lua_insert(L, -2);
+                lua_rawset(L, target);
+            }
+        }
+
+        lua_settop(L, target - 1);
+    }
+
+    lua_pop(L, 1);
+}
+
+void snapshot_reset(void)
+{
+    // the references died with the state, so the image lists are dropped without releasing them
+    if (ring != NULL)
+    {
+        for (int i = 0; i < ring_size; ++i)
+            serial_buffer_clear(&ring[i].images);
+    }
+    serial_buffer_clear(&captured_images);
+
+    // the buffers stay allocated so the next state starts with a warm ring
+    newest = -1;
+    stored = 0;
+    since_keyframe = 0;
+    registered_ref = LUA_NOREF;
+}
+
+// MARK: Lua Functions
+
+static int cmt_snapshot_register(lua_State* L)
+{
+    luaL_checkstring(L, 1);
+    if (!lua_isnil(L, 2))
+        luaL_checktype(L, 2, LUA_TTABLE);
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, registered_ref);
+    lua_pushvalue(L, 1);
+    lua_pushvalue(L, 2);
+    lua_rawset(L, -3);
+    return 0;
+}
+
+static int cmt_snapshot_save(lua_State* L)
+{
+    const int frame = (int)luaL_checkinteger(L, 1);
+    ensure_ring();
+
+    const char* error = capture(L);
+    if (error != NULL)
+        return luaL_error(L, "snapshot_save failed: %s", error);
+
+    const bool keyframe = stored == 0 || since_keyframe >= keyframe_interval;
+    newest = (newest + 1) % ring_size;
+
+    Snapshot* snapshot = &ring[newest];
+    snapshot->frame = frame;
+    snapshot->keyframe = keyframe;
+
+    // the frame this slot held is gone, and with it the last use of its images
+    entity_snapshot_release(L, &snapshot->images);
+    const SerialBuffer images = snapshot->images;
+    snapshot->images = captured_images;
+    captured_images = images;
+
+    size_t stored_bytes = 0;
+    size_t raw_bytes = 0;
+    for (int s = 0; s < SNAPSHOT_SECTION_COUNT; ++s)
+    {
+        snapshot->raw_size[s] = current[s].size;
+        delta_encode(&snapshot->delta[s], &current[s], keyframe ? NULL : &previous[s]);
+        stored_bytes += snapshot->delta[s].size;
+        raw_bytes += current[s].size;
+    }
+
+    swap_sections();
+    since_keyframe = keyframe ? 1 : since_keyframe + 1;
+    if (stored < ring_size)
+        stored++;
+
+    lua_pushinteger(L, (lua_Integer)stored_bytes);
+    lua_pushinteger(L, (lua_Integer)raw_bytes);
+    return 2;
+}
+
+static int cmt_snapshot_restore(lua_State* L)
+{
+    const int frame = (int)luaL_checkinteger(L, 1);
+
+    // newest first, so a frame that was saved again after a rollback resolves to its latest copy
+    int back = 0;
+    while (back < stored && ring[(newest - back + ring_size) % ring_size].frame != frame)
+        back++;
+
+    int keyframe_back = back;
+    while (keyframe_back < stored && !ring[(newest - keyframe_back + ring_size) % ring_size].keyframe)
+        keyframe_back++;
+
+    // either the frame was never saved or its keyframe has already been overwritten
+    if (keyframe_back >= stored)
+    {
+        lua_pushboolean(L, false);
+        return 1;
+    }
+
+    for (int s = 0; s < SNAPSHOT_SECTION_COUNT; ++s)
+        serial_buffer_clear(&current[s]);
+
+    for (int b = keyframe_back; b >= back; --b)
+    {
+        const Snapshot* snapshot = &ring[(newest - b + ring_size) % ring_size];
+        for (int s = 0; s < SNAPSHOT_SECTION_COUNT; ++s)
+        {
+            if (!delta_apply(&current[s], &snapshot->delta[s], snapshot->raw_size[s]))
+                return luaL_error(L, "snapshot_restore found a corrupted snapshot for frame %d", frame);
+        }
+    }
+
+    const SerialBuffer* script = &current[SNAPSHOT_SCRIPT];
+    if (!deserialize_value(L, script->data, script->size))
+        return luaL_error(L, "snapshot_restore could not decode the script state for frame %d", frame);
+
+    const SerialBuffer* native = &current[SNAPSHOT_NATIVE];
+    if (!entity_snapshot_restore(L, native->data, native->size))
+        return luaL_error(L, "snapshot_restore could not decode the entity state for frame %d", frame);
+
+    restore_script_tables(L, lua_gettop(L));
+    lua_pop(L, 1);
+
+    // frames after the restored one are about to be simulated again
+    swap_sections();
+    newest = (newest - back + ring_size) % ring_size;
+    stored -= back;
+    since_keyframe = keyframe_back - back + 1;
+
+    lua_pushboolean(L, true);
+    return 1;
+}
+
+static int cmt_snapshot_configure(lua_State* L)
+{
+    const lua_Integer size = luaL_checkinteger(L, 1);
+    const lua_Integer interval = luaL_optinteger(L, 2, size / 2);
+    luaL_argcheck(L, size >= 2, 1, "ring size must be at least 2");
+    luaL_argcheck(L, interval >= 1 && interval <= size, 2, "keyframe interval must be between 1 and the ring size");
+
+    free_ring(L);
+    ring_size = (int)size;
+    keyframe_interval = (int)interval;
+    ensure_ring();
+    return 0;
+}
+
+static int cmt_snapshot_count(lua_State* L)
+{
+    lua_pushinteger(L, stored);
+    return 1;
+}
+
+void register_snapshot_bindings(lua_State* L)
+{
+    lua_newtable(L);
+    registered_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+
+    lua_register(L, "snapshot_register", cmt_snapshot_register);
+    lua_register(L, "snapshot_save", cmt_snapshot_save);
+    lua_register(L, "snapshot_restore", cmt_snapshot_restore);
+    lua_register(L, "snapshot_configure", cmt_snapshot_configure);
+    lua_register(L, "snapshot_count", cmt_snapshot_count);
+}
@@ -0,0 +1,35 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "comet.h"
+#include "serialize.h"
+
+#define SNAPSHOT_DEFAULT_RING_SIZE 16
+#define SNAPSHOT_DEFAULT_KEYFRAME_INTERVAL 8
+
+// each section is delta compressed against the same section of the previous snapshot
+typedef enum SnapshotSection
+{
+    SNAPSHOT_NATIVE,
+    SNAPSHOT_SCRIPT,
+    SNAPSHOT_SECTION_COUNT
+} SnapshotSection;
+
+// one saved frame, keyframes are compressed against zeroes so they can be decoded on their own
+typedef struct Snapshot
+{
+    int frame;
+    bool keyframe;
+    size_t raw_size[SNAPSHOT_SECTION_COUNT];
+    SerialBuffer delta[SNAPSHOT_SECTION_COUNT];
+
+    // image references the native section uses, held until the slot is overwritten
+    SerialBuffer images;
+} Snapshot;
+
+// drops every saved frame and registered table, used when the Lua state is closed
+void snapshot_reset(void);
+
+void register_snapshot_bindings(lua_State* L);
+
+#endif //SNAPSHOT_H
@@ -0,0 +1,199 @@
+#include "telemetry.h"
+#include <stdio.h>
+#include <string.h>
+
+static const char* type_names[TELEMETRY_TYPE_COUNT] = {"image", "rect", "color", "camera", "animator", "layer", "entity", "font"};
+
+static TelemetryFrame current = {0};
+static TelemetryFrame last = {0};
+
+static bool overlay_enabled = false;
+static char dump_path[512] = {0};
+static int dump_interval = 0;
+
+// MARK: Tracking
+
+static size_t texture_size(const Texture2D texture)
+{
+    size_t size = (size_t)GetPixelDataSize(texture.width, texture.height, texture.format);
+
+    // a full mip chain adds roughly a third on top of the base level
+    if (texture.mipmaps > 1)
+        size += size / 3;
+
+    return size;
+}
+
+void telemetry_texture_loaded(const Texture2D texture)
+{
+    current.texture_count++;
+    current.texture_bytes += texture_size(texture);
+}
+
+void telemetry_texture_unloaded(const Texture2D texture)
+{
+    current.texture_count--;
+    current.texture_bytes -= texture_size(texture);
+}
+
+void telemetry_userdata_created(const TelemetryType type)
+{
+    current.userdata_created[type]++;
+}
+
+void telemetry_text_loaded(const size_t bytes)
+{
+    current.text_loaded_bytes += bytes;
+}
+
+// MARK: Output
+
+static void dump_frame(const TelemetryFrame* frame)
+{
+    const bool json = IsFileExtension(dump_path, ".json");
+    const bool exists = FileExists(dump_path);
+
+    FILE* file = fopen(dump_path, "a");
+    if (file == NULL)
+    {
+        printf("Could not open telemetry dump file \"%s\"\n", dump_path);
+        dump_interval = 0;
+        return;
+    }
+
+    if (json)
+    {
+        // one object per line so the file can be appended to without rewriting it
+        fprintf(file, "{\"frame\":%lu,\"frame_time\":%f,\"texture_count\":%d,\"texture_bytes\":%zu,"
+                "\"lua_live_bytes\":%zu,\"lua_peak_bytes\":%zu,\"lua_allocations\":%zu,\"text_loaded_bytes\":%zu",
+                frame->frame, frame->frame_time, frame->texture_count, frame->texture_bytes,
+                frame->lua_live_bytes, frame->lua_peak_bytes, frame->lua_allocations, frame->text_loaded_bytes);
+        for (int i = 0; i < TELEMETRY_TYPE_COUNT; ++i)
+            fprintf(file, ",\"%s_created\":%d", type_names[i], frame->userdata_created[i]);
+        fprintf(file, "}\n");
+    }
+    else
+    {
+        if (!exists)
+        {
+            fprintf(file, "frame,frame_time,texture_count,texture_bytes,lua_live_bytes,lua_peak_bytes,"
+                    "lua_allocations,text_loaded_bytes");
+            for (int i = 0; i < TELEMETRY_TYPE_COUNT; ++i)
+                fprintf(file, ",%s_created", type_names[i]);
+            fprintf(file, "\n");
+        }
+
+        fprintf(file, "%lu,%f,%d,%zu,%zu,%zu,%zu,%zu", frame->frame, frame->frame_time, frame->texture_count,
+                frame->texture_bytes, frame->lua_live_bytes, frame->lua_peak_bytes, frame->lua_allocations,
+                frame->text_loaded_bytes);
+        for (int i = 0; i < TELEMETRY_TYPE_COUNT; ++i)
+            fprintf(file, ",%d", frame->userdata_created[i]);
+        fprintf(file, "\n");
+    }
+
+    fclose(file);
+}
+
+void telemetry_draw_overlay(void)
+{
+    if (!overlay_enabled)
+        return;
+
+    // sits to the right of DrawFPS, values are from the last completed frame
+    const char* text = TextFormat("tex %d (%.1f MB)  lua %.1f MB (peak %.1f MB)  allocs %zu",
+                                  last.texture_count, (double)last.texture_bytes / (1024.0 * 1024.0),
+                                  (double)last.lua_live_bytes / (1024.0 * 1024.0),
+                                  (double)last.lua_peak_bytes / (1024.0 * 1024.0), last.lua_allocations);
+    DrawText(text, 100, 4, 10, LIME);
+}
+
+void telemetry_end_frame(const Engine* engine)
+{
+    const AllocatorStats* stats = &engine->allocator.stats;
+    current.frame_time = GetFrameTime();
+    current.lua_live_bytes = stats->live_bytes;
+    current.lua_peak_bytes = stats->peak_bytes;
+    current.lua_reserved_bytes = stats->reserved_bytes;
+    current.lua_allocations = stats->frame_allocations;
+    current.lua_system_allocations = stats->frame_system_allocations;
+
+    last = current;
+
+    if (dump_interval > 0 && current.frame % dump_interval == 0)
+        dump_frame(&last);
+
+    // live resource counts carry over, per frame counters start again
+    current.frame++;
+    memset(current.userdata_created, 0, sizeof(current.userdata_created));
+    current.text_loaded_bytes = 0;
+}
+
+// MARK: Lua Functions
+
+static int cmt_engine_stats(lua_State* L)
+{
+    lua_createtable(L, 0, 12);
+
+    lua_pushinteger(L, (lua_Integer)last.frame);
+    lua_setfield(L, -2, "frame");
+    lua_pushnumber(L, last.frame_time);
+    lua_setfield(L, -2, "frame_time");
+    lua_pushinteger(L, last.texture_count);
+    lua_setfield(L, -2, "texture_count");
+    lua_pushinteger(L, (lua_Integer)last.texture_bytes);
+    lua_setfield(L, -2, "texture_bytes");
+    lua_pushinteger(L, (lua_Integer)last.lua_live_bytes);
+    lua_setfield(L, -2, "lua_live_bytes");
+    lua_pushinteger(L, (lua_Integer)last.lua_peak_bytes);
+    lua_setfield(L, -2, "lua_peak_bytes");
+    lua_pushinteger(L, (lua_Integer)last.lua_reserved_bytes);
+    lua_setfield(L, -2, "lua_reserved_bytes");
+    lua_pushinteger(L, (lua_Integer)last.lua_allocations);
+    lua_setfield(L, -2, "lua_allocations");
+    lua_pushinteger(L, (lua_Integer)last.lua_system_allocations);
+    lua_setfield(L, -2, "lua_system_allocations");
+    lua_pushinteger(L, (lua_Integer)last.text_loaded_bytes);
+    lua_setfield(L, -2, "text_loaded_bytes");
+
+    lua_createtable(L, 0, TELEMETRY_TYPE_COUNT);
+    for (int i = 0; i < TELEMETRY_TYPE_COUNT; ++i)
+    {
+        lua_pushinteger(L, last.userdata_created[i]);
+        lua_setfield(L, -2, type_names[i]);
+    }
+    lua_setfield(L, -2, "userdata_created");
+
+    return 1;
+}
+
+static int cmt_engine_stats_overlay(lua_State* L)
+{
+    overlay_enabled = lua_toboolean(L, 1);
+    return 0;
+}
+
+static int cmt_engine_stats_dump(lua_State* L)
+{
+    // passing nil stops dumping
+    if (lua_isnoneornil(L, 1))
+    {
+        dump_interval = 0;
+        return 0;
+    }
+
+    const char* file_path = luaL_checkstring(L, 1);
+    const lua_Integer interval = luaL_optinteger(L, 2, 60);
+    luaL_argcheck(L, interval > 0, 2, "interval must be greater than zero");
+    luaL_argcheck(L, strlen(file_path) < sizeof(dump_path), 1, "path is too long");
+
+    strcpy(dump_path, file_path);
+    dump_interval = (int)interval;
+    return 0;
+}
+
+void register_telemetry_bindings(lua_State* L)
+{
+    lua_register(L, "engine_stats", cmt_engine_stats);
+    lua_register(L, "engine_stats_overlay", cmt_engine_stats_overlay);
+    lua_register(L, "engine_stats_dump", cmt_engine_stats_dump);
+}
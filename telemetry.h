@@ -0,0 +1,51 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include "comet.h"
+
+typedef enum TelemetryType
+{
+    TELEMETRY_IMAGE,
+    TELEMETRY_RECT,
+    TELEMETRY_COLOR,
+    TELEMETRY_CAMERA,
+    TELEMETRY_ANIMATOR,
+    TELEMETRY_LAYER,
+    TELEMETRY_ENTITY,
+    TELEMETRY_FONT,
+    TELEMETRY_TYPE_COUNT
+} TelemetryType;
+
+typedef struct TelemetryFrame
+{
+    unsigned long frame;
+    float frame_time;
+
+    // engine resources that are currently alive
+    int texture_count;
+    size_t texture_bytes;
+
+    // Lua heap as seen by the engine allocator
+    size_t lua_live_bytes;
+    size_t lua_peak_bytes;
+    size_t lua_reserved_bytes;
+    size_t lua_allocations;
+    size_t lua_system_allocations;
+
+    // per frame counters
+    int userdata_created[TELEMETRY_TYPE_COUNT];
+    size_t text_loaded_bytes;
+} TelemetryFrame;
+
+void telemetry_texture_loaded(Texture2D texture);
+void telemetry_texture_unloaded(Texture2D texture);
+void telemetry_userdata_created(TelemetryType type);
+void telemetry_text_loaded(size_t bytes);
+
+// called once per frame, draw_overlay inside drawing and end_frame after EndDrawing
+void telemetry_draw_overlay(void);
+void telemetry_end_frame(const Engine* engine);
+
+void register_telemetry_bindings(lua_State* L);
+
+#endif //TELEMETRY_H
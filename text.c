@@ -0,0 +1,405 @@
+#include "text.h"
+#include "bindings.h"
+#include "telemetry.h"
+#include "rlgl.h"
+#include <stdlib.h>
+#include <string.h>
+
+// matches the line spacing raylib uses for DrawTextEx
+#define TEXT_LINE_SPACING 2.0f
+
+static TextLayout cache[TEXT_CACHE_SIZE];
+static unsigned int cache_clock = 0;
+static unsigned int next_font_id = 1;
+
+// layouts that are rebuilt every draw, like formatted numbers, never enter the cache
+static TextLayout scratch;
+
+static int default_font_ref = LUA_NOREF;
+
+// MARK: Font Helpers
+
+// fonts carry glyph pointers, so anything that is not really a font has to be rejected before layout reads them
+static TextFont* cmt_check_font(lua_State* L, const int idx, const char* arg_name)
+{
+    return luaL_checkudata(L, idx, "__mt_font");
+}
+
+static TextFont* text_font_new(lua_State* L, const Font font, const bool owned, const float spacing)
+{
+    TextFont* text_font = lua_newuserdata(L, sizeof(TextFont));
+    text_font->font = font;
+    text_font->owned = owned;
+    text_font->id = next_font_id++;
+    text_font->spacing = spacing;
+
+    // glyphs missing from the atlas fall back to the first one, the same as raylib
+    for (int i = 0; i < 128; ++i)
+        text_font->ascii[i] = 0;
+    for (int i = 0; i < font.glyphCount; ++i)
+    {
+        if (font.glyphs[i].value >= 0 && font.glyphs[i].value < 128)
+            text_font->ascii[font.glyphs[i].value] = i;
+    }
+
+    luaL_getmetatable(L, "__mt_font");
+    lua_setmetatable(L, -2);
+
+    telemetry_userdata_created(TELEMETRY_FONT);
+    return text_font;
+}
+
+static int glyph_index(const TextFont* font, const int codepoint)
+{
+    if (codepoint >= 0 && codepoint < 128)
+        return font->ascii[codepoint];
+    return GetGlyphIndex(font->font, codepoint);
+}
+
+// MARK: Layout
+
+static unsigned int hash_text(const char* text, const size_t length)
+{
+    unsigned int hash = 2166136261u;
+    for (size_t i = 0; i < length; ++i)
+    {
+        hash ^= (unsigned char)text[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static void layout_reserve(TextLayout* layout, const int count)
+{
+    if (count <= layout->capacity)
+        return;
+
+    int capacity = layout->capacity > 0 ? layout->capacity : 16;
+    while (capacity < count)
+        capacity *= 2;
+
+    layout->source = realloc(layout->source, capacity * sizeof(Rectangle));
+    layout->dest = realloc(layout->dest, capacity * sizeof(Rectangle));
+    layout->capacity = capacity;
+}
+
+static void layout_free(TextLayout* layout)
+{
+    free(layout->source);
+    free(layout->dest);
+    free(layout->text);
+    memset(layout, 0, sizeof(TextLayout));
+}
+
+// same placement as raylib's DrawTextEx and DrawTextCodepoint, done once instead of on every draw
+static void layout_build(TextLayout* layout, const TextFont* font, const char* text, const size_t length, const float size)
+{
+    const Font* atlas = &font->font;
+    const float scale = size / (float)atlas->baseSize;
+    const float spacing = font->spacing * scale;
+    const float padding = (float)atlas->glyphPadding;
+
+    // every byte is at most one glyph, so this is enough for the whole string
+    layout_reserve(layout, (int)length);
+    layout->count = 0;
+
+    float offset_x = 0.0f;
+    float offset_y = 0.0f;
+    float width = 0.0f;
+
+    for (size_t i = 0; i < length;)
+    {
+        int byte_count = 0;
+        const int codepoint = GetCodepointNext(text + i, &byte_count);
+        i += byte_count;
+
+        if (codepoint == '\n')
+        {
+            if (offset_x - spacing > width)
+                width = offset_x - spacing;
+
+            offset_x = 0.0f;
+            offset_y += size + TEXT_LINE_SPACING;
+            continue;
+        }
+
+        const int index = glyph_index(font, codepoint);
+        const GlyphInfo* glyph = &atlas->glyphs[index];
+        const Rectangle* rec = &atlas->recs[index];
+
+        if (codepoint != ' ' && codepoint != '\t')
+        {
+            layout->source[layout->count] = (Rectangle){
+                rec->x - padding, rec->y - padding,
+                rec->width + 2.0f * padding, rec->height + 2.0f * padding
+            };
+            layout->dest[layout->count] = (Rectangle){
+                offset_x + ((float)glyph->offsetX - padding) * scale,
+                offset_y + ((float)glyph->offsetY - padding) * scale,
+                (rec->width + 2.0f * padding) * scale,
+                (rec->height + 2.0f * padding) * scale
+            };
+            layout->count++;
+        }
+
+        if (glyph->advanceX == 0)
+            offset_x += rec->width * scale + spacing;
+        else
+            offset_x += (float)glyph->advanceX * scale + spacing;
+    }
+
+    if (offset_x - spacing > width)
+        width = offset_x - spacing;
+
+    layout->width = width > 0.0f ? width : 0.0f;
+    layout->height = offset_y + size;
+}
+
+static TextLayout* layout_lookup(const TextFont* font, const char* text, const size_t length, const float size)
+{
+    const unsigned int hash = hash_text(text, length);
+    const unsigned int key = hash ^ (font->id * 2654435761u) ^ (unsigned int)(size * 64.0f);
+
+    cache_clock++;
+
+    // the probe window doubles as the eviction set, the least recently drawn layout in it is replaced
+    TextLayout* victim = NULL;
+    for (int i = 0; i < TEXT_CACHE_PROBE; ++i)
+    {
+        TextLayout* layout = &cache[(key + i) & (TEXT_CACHE_SIZE - 1)];
+        if (layout->font_id == font->id && layout->hash == hash && layout->size == size &&
+            layout->length == length && memcmp(layout->text, text, length) == 0)
+        {
+            layout->last_used = cache_clock;
+            return layout;
+        }
+
+        if (victim == NULL || layout->font_id == 0 ||
+            (victim->font_id != 0 && layout->last_used < victim->last_used))
+            victim = layout;
+    }
+
+    if (victim->length < length || victim->text == NULL)
+        victim->text = realloc(victim->text, length + 1);
+    memcpy(victim->text, text, length);
+    victim->text[length] = '\0';
+
+    victim->hash = hash;
+    victim->font_id = font->id;
+    victim->size = size;
+    victim->length = length;
+    victim->last_used = cache_clock;
+
+    layout_build(victim, font, text, length, size);
+    return victim;
+}
+
+// MARK: Drawing
+
+// the whole string goes out as one textured batch instead of a draw call per glyph
+static void layout_draw(const TextLayout* layout, const TextFont* font, const float x, const float y, const Color color)
+{
+    if (layout->count == 0)
+        return;
+
+    const Texture2D texture = font->font.texture;
+    const float texture_width = (float)texture.width;
+    const float texture_height = (float)texture.height;
+
+    rlCheckRenderBatchLimit(layout->count * 4);
+    rlSetTexture(texture.id);
+    rlBegin(RL_QUADS);
+    rlColor4ub(color.r, color.g, color.b, color.a);
+
+    for (int i = 0; i < layout->count; ++i)
+    {
+        const Rectangle* src = &layout->source[i];
+        const Rectangle* dest = &layout->dest[i];
+
+        const float left = x + dest->x;
+        const float top = y + dest->y;
+        const float u0 = src->x / texture_width;
+        const float v0 = src->y / texture_height;
+        const float u1 = (src->x + src->width) / texture_width;
+        const float v1 = (src->y + src->height) / texture_height;
+
+        rlTexCoord2f(u0, v0);
+        rlVertex2f(left, top);
+        rlTexCoord2f(u0, v1);
+        rlVertex2f(left, top + dest->height);
+        rlTexCoord2f(u1, v1);
+        rlVertex2f(left + dest->width, top + dest->height);
+        rlTexCoord2f(u1, v0);
+        rlVertex2f(left + dest->width, top);
+    }
+
+    rlEnd();
+    rlSetTexture(0);
+}
+
+void text_reset(void)
+{
+    for (int i = 0; i < TEXT_CACHE_SIZE; ++i)
+        layout_free(&cache[i]);
+    layout_free(&scratch);
+
+    cache_clock = 0;
+    default_font_ref = LUA_NOREF;
+}
+
+// MARK: Lua Functions
+
+static int cmt_font_load(lua_State* L)
+{
+    const char* file_path = luaL_checkstring(L, 1);
+    const int size = (int)luaL_checkinteger(L, 2);
+    const lua_Number spacing = luaL_optnumber(L, 3, 0.0);
+    luaL_argcheck(L, size > 0, 2, "font size must be positive");
+
+    const Font font = LoadFontEx(file_path, size, NULL, 0);
+
+    // raylib hands back the default font when loading fails
+    if (font.texture.id == GetFontDefault().texture.id)
+    {
+        return luaL_error(L, "font_load failed to load font at \"%s\"\n", file_path);
+    }
+
+    text_font_new(L, font, true, (float)spacing);
+    telemetry_texture_loaded(font.texture);
+    return 1;
+}
+
+static int cmt_font_default(lua_State* L)
+{
+    // the default font belongs to raylib, so every call shares one userdata that never unloads it
+    if (default_font_ref == LUA_NOREF)
+    {
+        text_font_new(L, GetFontDefault(), false, 1.0f);
+        lua_pushvalue(L, -1);
+        default_font_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+        return 1;
+    }
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, default_font_ref);
+    return 1;
+}
+
+static int cmt_font_gc(lua_State* L)
+{
+    TextFont* font = cmt_check_font(L, 1, "font");
+
+    // font ids are never reused, so layouts made with this font simply stop matching and age out
+    if (font->owned && font->font.texture.id != 0)
+    {
+        telemetry_texture_unloaded(font->font.texture);
+        UnloadFont(font->font);
+        font->font.texture.id = 0;
+    }
+    return 0;
+}
+
+static int cmt_font_index(lua_State* L)
+{
+    const TextFont* font = cmt_check_font(L, 1, "font");
+    const char* key = luaL_checkstring(L, 2);
+
+    if (strcmp(key, "base_size") == 0)
+    {
+        lua_pushinteger(L, font->font.baseSize);
+    }
+    else if (strcmp(key, "glyph_count") == 0)
+    {
+        lua_pushinteger(L, font->font.glyphCount);
+    }
+    else if (strcmp(key, "spacing") == 0)
+    {
+        lua_pushnumber(L, font->spacing);
+    }
+    else
+    {
+        return luaL_error(L, "Font has no field \"%s\".", key);
+    }
+
+    return 1;
+}
+
+static int cmt_text_draw(lua_State* L)
+{
+    const TextFont* font = cmt_check_font(L, 1, "font");
+    size_t length = 0;
+    const char* text = luaL_checklstring(L, 2, &length);
+    const lua_Number x = luaL_checknumber(L, 3);
+    const lua_Number y = luaL_checknumber(L, 4);
+    const lua_Number size = luaL_checknumber(L, 5);
+    const Color* color = cmt_check_color(L, 6, "color");
+
+    const TextLayout* layout = layout_lookup(font, text, length, (float)size);
+    layout_draw(layout, font, (float)x, (float)y, *color);
+    return 0;
+}
+
+static int cmt_text_measure(lua_State* L)
+{
+    const TextFont* font = cmt_check_font(L, 1, "font");
+    size_t length = 0;
+    const char* text = luaL_checklstring(L, 2, &length);
+    const lua_Number size = luaL_checknumber(L, 3);
+
+    // measuring goes through the cache too, labels are usually measured right before they are drawn
+    const TextLayout* layout = layout_lookup(font, text, length, (float)size);
+    lua_pushnumber(L, layout->width);
+    lua_pushnumber(L, layout->height);
+    return 2;
+}
+
+static int cmt_text_draw_number(lua_State* L)
+{
+    const TextFont* font = cmt_check_font(L, 1, "font");
+    const lua_Number number = luaL_checknumber(L, 2);
+    const lua_Number x = luaL_checknumber(L, 3);
+    const lua_Number y = luaL_checknumber(L, 4);
+    const lua_Number size = luaL_checknumber(L, 5);
+    const Color* color = cmt_check_color(L, 6, "color");
+
+    // counters change every frame, caching them would only churn the cache, and formatting here skips
+    // creating a Lua string per frame
+    char buffer[64];
+    int length;
+    if (lua_isnoneornil(L, 7))
+    {
+        length = snprintf(buffer, sizeof(buffer), LUA_NUMBER_FMT, number);
+    }
+    else
+    {
+        const int decimals = (int)luaL_checkinteger(L, 7);
+        luaL_argcheck(L, decimals >= 0 && decimals <= 16, 7, "decimals must be between 0 and 16");
+        length = snprintf(buffer, sizeof(buffer), "%.*f", decimals, number);
+    }
+
+    if (length < 0)
+        return 0;
+    if (length >= (int)sizeof(buffer))
+        length = sizeof(buffer) - 1;
+
+    layout_build(&scratch, font, buffer, (size_t)length, (float)size);
+    layout_draw(&scratch, font, (float)x, (float)y, *color);
+    return 0;
+}
+
+void register_text_bindings(lua_State* L)
+{
+    lua_register(L, "font_load", cmt_font_load);
+    lua_register(L, "font_default", cmt_font_default);
+    lua_register(L, "text_draw", cmt_text_draw);
+    lua_register(L, "text_measure", cmt_text_measure);
+    lua_register(L, "text_draw_number", cmt_text_draw_number);
+
+    if (!luaL_newmetatable(L, "__mt_font"))
+        printf("Lua error: Font metatable at __mt_font already exists\n");
+
+    lua_pushcfunction(L, cmt_font_index);
+    lua_setfield(L, -2, "__index");
+    lua_pushcfunction(L, cmt_font_gc);
+    lua_setfield(L, -2, "__gc");
+    lua_pop(L, 1);
+}
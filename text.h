@@ -0,0 +1,45 @@
+#ifndef TEXT_H
+#define TEXT_H
+
+#include "comet.h"
+
+#define TEXT_CACHE_SIZE 512
+#define TEXT_CACHE_PROBE 8
+
+// a glyph atlas along with a direct lookup for ascii, raylib searches the glyph list linearly
+typedef struct TextFont
+{
+    Font font;
+    bool owned;
+    unsigned int id;
+
+    // extra space between glyphs at the font's base size
+    float spacing;
+    int ascii[128];
+} TextFont;
+
+// glyph quads of a laid out string, positioned relative to the top left of the text
+typedef struct TextLayout
+{
+    unsigned int hash;
+    unsigned int font_id;
+    float size;
+    char* text;
+    size_t length;
+
+    Rectangle* source;
+    Rectangle* dest;
+    int count;
+    int capacity;
+
+    float width;
+    float height;
+    unsigned int last_used;
+} TextLayout;
+
+// frees every cached layout, used when the Lua state that owns the fonts is closed
+void text_reset(void);
+
+void register_text_bindings(lua_State* L);
+
+#endif //TEXT_H
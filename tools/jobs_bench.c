@@ -0,0 +1,192 @@
+// measures how the job system scales with the number of threads
+// usage: comet_jobs_bench [max_threads]
+
+#define _XOPEN_SOURCE 700
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "jobs.h"
+
+#define BENCH_ITERATIONS 50
+
+// the parallel_for workload is the same shape as the entity movement pass
+#define ELEMENT_COUNT (1 << 20)
+#define ELEMENT_BATCH_SIZE 4096
+
+// the nested workload has every outer job spawn and wait on its own inner jobs
+#define OUTER_JOB_COUNT 64
+#define INNER_JOB_COUNT 64
+#define INNER_JOB_STEPS 2000
+
+typedef struct MoveData
+{
+    float* x;
+    const float* vx;
+    float dt;
+} MoveData;
+
+typedef struct InnerJob
+{
+    unsigned int seed;
+    unsigned int result;
+} InnerJob;
+
+typedef struct OuterJob
+{
+    InnerJob inner[INNER_JOB_COUNT];
+    unsigned int result;
+} OuterJob;
+
+static double now_seconds(void)
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (double)time.tv_sec + (double)time.tv_nsec / 1e9;
+}
+
+// MARK: Workloads
+
+static void move_range(void* data, const int start, const int end)
+{
+    const MoveData* move = data;
+    for (int i = start; i < end; ++i)
+        move->x[i] += move->vx[i] * move->dt;
+}
+
+static void run_inner(void* data)
+{
+    InnerJob* job = data;
+
+    // xorshift keeps the work opaque to the compiler and gives a result to check
+    unsigned int state = job->seed;
+    for (int i = 0; i < INNER_JOB_STEPS; ++i)
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+    }
+    job->result = state;
+}
+
+static void run_outer(void* data)
+{
+    OuterJob* job = data;
+    JobCounter counter = {0};
+
+    for (int i = 0; i < INNER_JOB_COUNT; ++i)
+        jobs_run(run_inner, &job->inner[i], &counter);
+    jobs_wait(&counter);
+
+    job->result = 0;
+    for (int i = 0; i < INNER_JOB_COUNT; ++i)
+        job->result ^= job->inner[i].result;
+}
+
+static unsigned int run_nested(OuterJob* outer)
+{
+    JobCounter counter = {0};
+    for (int i = 0; i < OUTER_JOB_COUNT; ++i)
+        jobs_run(run_outer, &outer[i], &counter);
+    jobs_wait(&counter);
+
+    unsigned int result = 0;
+    for (int i = 0; i < OUTER_JOB_COUNT; ++i)
+        result ^= outer[i].result;
+    return result;
+}
+
+// MARK: Benchmark
+
+int main(const int argc, char** argv)
+{
+    int max_threads = jobs_default_worker_count() + 1;
+    if (argc > 1)
+        max_threads = atoi(argv[1]);
+
+    if (argc > 2 || max_threads < 1 || max_threads > JOBS_MAX_WORKERS + 1)
+    {
+        printf("usage: %s [max_threads], between 1 and %d\n", argv[0], JOBS_MAX_WORKERS + 1);
+        return 1;
+    }
+
+    float* x = malloc(sizeof(float) * ELEMENT_COUNT);
+    float* vx = malloc(sizeof(float) * ELEMENT_COUNT);
+    OuterJob* outer = malloc(sizeof(OuterJob) * OUTER_JOB_COUNT);
+    for (int i = 0; i < ELEMENT_COUNT; ++i)
+        vx[i] = (float)(i % 100) * 0.01f;
+    for (int i = 0; i < OUTER_JOB_COUNT; ++i)
+    {
+        for (int j = 0; j < INNER_JOB_COUNT; ++j)
+            outer[i].inner[j].seed = (unsigned int)(i * INNER_JOB_COUNT + j + 1);
+    }
+
+    printf("threads  parallel_for ms  speedup  nested ms  speedup\n");
+
+    double base_parallel = 0.0;
+    double base_nested = 0.0;
+    unsigned int expected = 0;
+    bool valid = true;
+
+    // powers of two up to the maximum, which is always measured
+    for (int threads = 1;; threads = threads * 2 < max_threads ? threads * 2 : max_threads)
+    {
+        jobs_initialise(threads - 1);
+        if (jobs_thread_count() != threads)
+        {
+            printf("only %d of %d threads could be started\n", jobs_thread_count(), threads);
+            jobs_shutdown();
+            break;
+        }
+
+        for (int i = 0; i < ELEMENT_COUNT; ++i)
+            x[i] = 0.0f;
+        MoveData move = {x, vx, 1.0f / 60.0f};
+
+        double start = now_seconds();
+        for (int iteration = 0; iteration < BENCH_ITERATIONS; ++iteration)
+            jobs_parallel_for(ELEMENT_COUNT, ELEMENT_BATCH_SIZE, move_range, &move);
+        const double parallel_time = (now_seconds() - start) * 1000.0 / BENCH_ITERATIONS;
+
+        // every element must have moved exactly once per iteration
+        const float moved = vx[ELEMENT_COUNT - 1] * move.dt * BENCH_ITERATIONS;
+        if (x[ELEMENT_COUNT - 1] < moved * 0.999f || x[ELEMENT_COUNT - 1] > moved * 1.001f)
+            valid = false;
+
+        unsigned int result = 0;
+        start = now_seconds();
+        for (int iteration = 0; iteration < BENCH_ITERATIONS; ++iteration)
+            result = run_nested(outer);
+        const double nested_time = (now_seconds() - start) * 1000.0 / BENCH_ITERATIONS;
+
+        if (threads == 1)
+        {
+            base_parallel = parallel_time;
+            base_nested = nested_time;
+            expected = result;
+        }
+        else if (result != expected)
+        {
+            valid = false;
+        }
+
+        printf("%7d  %15.3f  %6.2fx  %9.3f  %6.2fx\n", threads, parallel_time, base_parallel / parallel_time,
+               nested_time, base_nested / nested_time);
+
+        jobs_shutdown();
+        if (threads == max_threads)
+            break;
+    }
+
+    free(x);
+    free(vx);
+    free(outer);
+
+    if (!valid)
+    {
+        printf("results differ between thread counts\n");
+        return 1;
+    }
+    return 0;
+}
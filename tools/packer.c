@@ -0,0 +1,263 @@
+// builds the compressed asset pack that release builds mount instead of the raw user directory
+// usage: comet_packer <user_directory> <output_pack> [--bench]
+
+#define _XOPEN_SOURCE 700
+#include <ftw.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "util/lz4.h"
+
+// the engine side of the format lives in pack.h, which pulls in raylib and Lua, so the constants are repeated here
+#define PACK_MAGIC "CPAK"
+#define PACK_VERSION 1
+#define PACK_CODEC_RAW 0
+#define PACK_CODEC_LZ4 1
+
+#define BENCH_ITERATIONS 20
+
+typedef struct PackerEntry
+{
+    char* path;
+    unsigned char* stored;
+    uint32_t stored_size;
+    uint32_t raw_size;
+    uint32_t offset;
+    unsigned char codec;
+} PackerEntry;
+
+static PackerEntry* entries = NULL;
+static int entry_count = 0;
+static int entry_capacity = 0;
+static size_t root_length = 0;
+
+static unsigned char* read_file(const char* file_path, size_t* size)
+{
+    FILE* file = fopen(file_path, "rb");
+    if (file == NULL)
+        return NULL;
+
+    fseek(file, 0, SEEK_END);
+    const long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    unsigned char* data = malloc(length > 0 ? (size_t)length : 1);
+    if (data != NULL && fread(data, 1, (size_t)length, file) != (size_t)length)
+    {
+        free(data);
+        data = NULL;
+    }
+
+    fclose(file);
+    *size = (size_t)length;
+    return data;
+}
+
+static void write_u32(FILE* file, const uint32_t value)
+{
+    const unsigned char bytes[4] = {value & 0xff, (value >> 8) & 0xff, (value >> 16) & 0xff, (value >> 24) & 0xff};
+    fwrite(bytes, 1, 4, file);
+}
+
+static double now_seconds(void)
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (double)time.tv_sec + (double)time.tv_nsec / 1e9;
+}
+
+// MARK: Collecting
+
+static int add_file(const char* file_path, const struct stat* sb, const int type_flag, struct FTW* ftw_buffer)
+{
+    if (type_flag != FTW_F)
+        return 0;
+
+    size_t raw_size = 0;
+    unsigned char* raw = read_file(file_path, &raw_size);
+    if (raw == NULL || raw_size > UINT32_MAX)
+    {
+        printf("\"%s\" could not be read\n", file_path);
+        return 1;
+    }
+
+    if (entry_count == entry_capacity)
+    {
+        entry_capacity = entry_capacity > 0 ? entry_capacity * 2 : 64;
+        entries = realloc(entries, entry_capacity * sizeof(PackerEntry));
+    }
+
+    PackerEntry* entry = &entries[entry_count++];
+
+    // stored relative to the user directory, without a leading slash
+    const char* relative = file_path + root_length;
+    while (*relative == '/')
+        relative++;
+    entry->path = strdup(relative);
+    entry->raw_size = (uint32_t)raw_size;
+
+    // files that do not shrink, like most PNGs already deflated, are stored as they are
+    unsigned char* compressed = malloc(lz4_compress_bound(raw_size));
+    const size_t compressed_size = lz4_compress(raw, raw_size, compressed, lz4_compress_bound(raw_size));
+    if (compressed_size > 0 && compressed_size < raw_size)
+    {
+        entry->codec = PACK_CODEC_LZ4;
+        entry->stored = compressed;
+        entry->stored_size = (uint32_t)compressed_size;
+        free(raw);
+    }
+    else
+    {
+        entry->codec = PACK_CODEC_RAW;
+        entry->stored = raw;
+        entry->stored_size = (uint32_t)raw_size;
+        free(compressed);
+    }
+
+    return 0;
+}
+
+static int compare_entries(const void* a, const void* b)
+{
+    return strcmp(((const PackerEntry*)a)->path, ((const PackerEntry*)b)->path);
+}
+
+// MARK: Writing
+
+static bool write_pack(const char* output_path)
+{
+    FILE* file = fopen(output_path, "wb");
+    if (file == NULL)
+        return false;
+
+    uint32_t index_size = 0;
+    uint32_t offset = 0;
+    for (int i = 0; i < entry_count; ++i)
+    {
+        index_size += 2 + (uint32_t)strlen(entries[i].path) + 13;
+        entries[i].offset = offset;
+        offset += entries[i].stored_size;
+    }
+
+    const unsigned char version[4] = {PACK_VERSION, 0, 0, 0};
+    fwrite(PACK_MAGIC, 1, 4, file);
+    fwrite(version, 1, 4, file);
+    write_u32(file, (uint32_t)entry_count);
+    write_u32(file, index_size);
+
+    for (int i = 0; i < entry_count; ++i)
+    {
+        const PackerEntry* entry = &entries[i];
+        const size_t length = strlen(entry->path);
+        const unsigned char length_bytes[2] = {length & 0xff, (length >> 8) & 0xff};
+        fwrite(length_bytes, 1, 2, file);
+        fwrite(entry->path, 1, length, file);
+        fwrite(&entry->codec, 1, 1, file);
+        write_u32(file, entry->offset);
+        write_u32(file, entry->stored_size);
+        write_u32(file, entry->raw_size);
+    }
+
+    for (int i = 0; i < entry_count; ++i)
+        fwrite(entries[i].stored, 1, entries[i].stored_size, file);
+
+    const bool written = ferror(file) == 0;
+    fclose(file);
+    return written;
+}
+
+// MARK: Benchmark
+
+// compares reading every file from the directory against reading the pack once and decoding every entry
+static void run_benchmark(const char* root, const char* output_path)
+{
+    char file_path[4096];
+    double raw_time = 0.0;
+    double pack_time = 0.0;
+
+    for (int iteration = 0; iteration < BENCH_ITERATIONS; ++iteration)
+    {
+        double start = now_seconds();
+        for (int i = 0; i < entry_count; ++i)
+        {
+            snprintf(file_path, sizeof(file_path), "%s/%s", root, entries[i].path);
+            size_t size = 0;
+            free(read_file(file_path, &size));
+        }
+        raw_time += now_seconds() - start;
+
+        start = now_seconds();
+        size_t pack_size = 0;
+        unsigned char* pack = read_file(output_path, &pack_size);
+        const uint32_t index_size = (uint32_t)pack[12] | (uint32_t)pack[13] << 8 | (uint32_t)pack[14] << 16 | (uint32_t)pack[15] << 24;
+        const unsigned char* data = pack + 16 + index_size;
+
+        for (int i = 0; i < entry_count; ++i)
+        {
+            const PackerEntry* entry = &entries[i];
+            unsigned char* raw = malloc(entry->raw_size > 0 ? entry->raw_size : 1);
+            if (entry->codec == PACK_CODEC_LZ4)
+                lz4_decompress(data + entry->offset, entry->stored_size, raw, entry->raw_size);
+            else
+                memcpy(raw, data + entry->offset, entry->raw_size);
+            free(raw);
+        }
+        free(pack);
+        pack_time += now_seconds() - start;
+    }
+
+    printf("raw files: %.3f ms per load\n", raw_time * 1000.0 / BENCH_ITERATIONS);
+    printf("pack:      %.3f ms per load\n", pack_time * 1000.0 / BENCH_ITERATIONS);
+}
+
+int main(const int argc, char** argv)
+{
+    if (argc < 3)
+    {
+        printf("usage: %s <user_directory> <output_pack> [--bench]\n", argv[0]);
+        return 1;
+    }
+
+    const char* root = argv[1];
+    const char* output_path = argv[2];
+    const bool bench = argc > 3 && strcmp(argv[3], "--bench") == 0;
+
+    root_length = strlen(root);
+    if (nftw(root, add_file, 64, FTW_PHYS) != 0)
+    {
+        printf("\"%s\" could not be packed\n", root);
+        return 1;
+    }
+
+    qsort(entries, entry_count, sizeof(PackerEntry), compare_entries);
+
+    if (!write_pack(output_path))
+    {
+        printf("\"%s\" could not be written\n", output_path);
+        return 1;
+    }
+
+    size_t raw_total = 0;
+    size_t stored_total = 0;
+    for (int i = 0; i < entry_count; ++i)
+    {
+        raw_total += entries[i].raw_size;
+        stored_total += entries[i].stored_size;
+    }
+    printf("packed %d files, %zu bytes into %zu bytes\n", entry_count, raw_total, stored_total);
+
+    if (bench)
+        run_benchmark(root, output_path);
+
+    for (int i = 0; i < entry_count; ++i)
+    {
+        free(entries[i].path);
+        free(entries[i].stored);
+    }
+    free(entries);
+    return 0;
+}
@@ -0,0 +1,174 @@
+// measures snapshot save and restore latency on a scene shaped like a rollback game
+// usage: comet_snapshot_bench [entity_count]
+
+#define _XOPEN_SOURCE 700
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "bindings.h"
+#include "entity.h"
+
+#define BENCH_FRAMES 600
+#define DEFAULT_ENTITY_COUNT 10000
+
+// every few frames the scene rolls back a handful of frames and simulates them again
+#define ROLLBACK_INTERVAL 4
+#define ROLLBACK_FRAMES 6
+
+static const char* bench_script =
+    "world = {frame = 0, units = {}}\n"
+    "snapshot_register('world', world)\n"
+    "snapshot_configure(16, 8)\n"
+    "function setup(count)\n"
+    "    for i = 1, count do\n"
+    "        local e = entity_new(i % 100 * 5, math.floor(i / 100) * 5, 4, 4)\n"
+    "        e.vx = i % 11 - 5\n"
+    "        e.vy = i % 13 - 6\n"
+    "        if i % 10 == 0 then\n"
+    "            world.units[#world.units + 1] = {entity = e, hp = 100, name = 'unit' .. i}\n"
+    "        end\n"
+    "    end\n"
+    "end\n"
+    "function step(frame)\n"
+    "    world.frame = frame\n"
+    "    local units = world.units\n"
+    "    for i = frame % 8 + 1, #units, 8 do\n"
+    "        units[i].hp = units[i].hp - 1\n"
+    "    end\n"
+    "end\n";
+
+typedef struct Samples
+{
+    double* values;
+    int count;
+} Samples;
+
+static double now_seconds(void)
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (double)time.tv_sec + (double)time.tv_nsec / 1e9;
+}
+
+static int compare_doubles(const void* a, const void* b)
+{
+    const double x = *(const double*)a;
+    const double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static void print_samples(const char* name, Samples* samples)
+{
+    if (samples->count == 0)
+        return;
+
+    qsort(samples->values, samples->count, sizeof(double), compare_doubles);
+    double total = 0.0;
+    for (int i = 0; i < samples->count; ++i)
+        total += samples->values[i];
+
+    printf("%-8s %10.1f %10.1f %10.1f %10.1f\n", name, total * 1e6 / samples->count,
+           samples->values[samples->count / 2] * 1e6, samples->values[samples->count * 99 / 100] * 1e6,
+           samples->values[samples->count - 1] * 1e6);
+}
+
+// MARK: Lua Calls
+
+static void fail(lua_State* L)
+{
+    printf("Lua error: %s\n", lua_tostring(L, -1));
+    exit(1);
+}
+
+static void call_with_integer(lua_State* L, const char* name, const int value, const int results)
+{
+    lua_getglobal(L, name);
+    lua_pushinteger(L, value);
+    if (lua_pcall(L, 1, results, 0))
+        fail(L);
+}
+
+static void simulate(lua_State* L, const int frame)
+{
+    call_with_integer(L, "step", frame, 0);
+    entity_update(1.0f / 60.0f);
+}
+
+static void save(lua_State* L, const int frame, Samples* samples, double* stored_bytes, double* raw_bytes)
+{
+    const double start = now_seconds();
+    call_with_integer(L, "snapshot_save", frame, 2);
+    samples->values[samples->count++] = now_seconds() - start;
+
+    *stored_bytes += lua_tonumber(L, -2);
+    *raw_bytes += lua_tonumber(L, -1);
+    lua_pop(L, 2);
+}
+
+// MARK: Benchmark
+
+int main(const int argc, char** argv)
+{
+    const int entity_count = argc > 1 ? atoi(argv[1]) : DEFAULT_ENTITY_COUNT;
+    if (argc > 2 || entity_count < 1 || entity_count > ENTITY_MAX_COUNT)
+    {
+        printf("usage: %s [entity_count], between 1 and %d\n", argv[0], ENTITY_MAX_COUNT);
+        return 1;
+    }
+
+    Engine engine = {NULL, false};
+    allocator_initialise(&engine.allocator);
+    initialise_lua(&engine);
+    lua_State* L = engine.L;
+
+    if (luaL_loadstring(L, bench_script) || lua_pcall(L, 0, 0, 0))
+        fail(L);
+    call_with_integer(L, "setup", entity_count, 0);
+
+    // every frame is saved once, and again each time a rollback simulates it
+    const int max_saves = BENCH_FRAMES * (ROLLBACK_FRAMES + ROLLBACK_INTERVAL) / ROLLBACK_INTERVAL + 1;
+    Samples saves = {malloc(sizeof(double) * max_saves), 0};
+    Samples restores = {malloc(sizeof(double) * (BENCH_FRAMES / ROLLBACK_INTERVAL + 1)), 0};
+    double stored_bytes = 0.0;
+    double raw_bytes = 0.0;
+
+    for (int frame = 0; frame < BENCH_FRAMES; ++frame)
+    {
+        simulate(L, frame);
+        save(L, frame, &saves, &stored_bytes, &raw_bytes);
+
+        if (frame < ROLLBACK_FRAMES || frame % ROLLBACK_INTERVAL != 0)
+            continue;
+
+        const double start = now_seconds();
+        call_with_integer(L, "snapshot_restore", frame - ROLLBACK_FRAMES, 1);
+        restores.values[restores.count++] = now_seconds() - start;
+
+        if (!lua_toboolean(L, -1))
+        {
+            printf("frame %d could not be restored\n", frame - ROLLBACK_FRAMES);
+            return 1;
+        }
+        lua_pop(L, 1);
+
+        for (int replay = frame - ROLLBACK_FRAMES + 1; replay <= frame; ++replay)
+        {
+            simulate(L, replay);
+            save(L, replay, &saves, &stored_bytes, &raw_bytes);
+        }
+    }
+
+    printf("%d entities, %d frames, %d saves, %d restores\n", entity_count, BENCH_FRAMES, saves.count, restores.count);
+    printf("%-8s %10s %10s %10s %10s\n", "us", "mean", "median", "p99", "max");
+    print_samples("save", &saves);
+    print_samples("restore", &restores);
+    printf("stored %.0f of %.0f bytes per snapshot (%.1f%%)\n", stored_bytes / saves.count, raw_bytes / saves.count,
+           raw_bytes > 0.0 ? stored_bytes * 100.0 / raw_bytes : 0.0);
+
+    free(saves.values);
+    free(restores.values);
+    close_lua(&engine);
+    allocator_destroy(&engine.allocator);
+    return 0;
+}
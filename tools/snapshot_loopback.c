@@ -0,0 +1,188 @@
+// runs the same simulation in two engine instances, one straight through and one that keeps rolling back,
+// and checks that every restored and replayed frame matches the uninterrupted run
+// usage: comet_snapshot_loopback [frames]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bindings.h"
+#include "entity.h"
+
+#define DEFAULT_FRAMES 600
+
+// must stay below the ring size so the target frame is always still saved
+#define ROLLBACK_INTERVAL 5
+#define ROLLBACK_FRAMES 7
+
+// entities are created and destroyed all the time so slots, generations and handles held by scripts get reused
+static const char* loopback_script =
+    "state = {frame = 0, score = 0, spawned = 0, entities = {}}\n"
+    "snapshot_register('state', state)\n"
+    "snapshot_configure(16, 8)\n"
+    "function step(frame)\n"
+    "    state.frame = frame\n"
+    "    local entities = state.entities\n"
+    "    if frame % 3 == 0 then\n"
+    "        state.spawned = state.spawned + 1\n"
+    "        local e = entity_new(state.spawned % 50 * 10, state.spawned % 30 * 10, 8, 8)\n"
+    "        e.vx = (state.spawned % 7 - 3) * 20\n"
+    "        e.vy = (state.spawned % 5 - 2) * 20\n"
+    "        entities[#entities + 1] = e\n"
+    "    end\n"
+    "    if frame % 7 == 0 and #entities > 0 then\n"
+    "        entity_destroy(table.remove(entities, 1))\n"
+    "    end\n"
+    "    for i = 1, #entities do\n"
+    "        local e = entities[i]\n"
+    "        if e.x < 0 or e.x > 500 then e.vx = -e.vx state.score = state.score + 1 end\n"
+    "        if e.y < 0 or e.y > 300 then e.vy = -e.vy state.score = state.score + 1 end\n"
+    "    end\n"
+    "end\n"
+    "function digest()\n"
+    "    local parts = {string.format('%d %d %d', state.frame, state.score, state.spawned)}\n"
+    "    for _, e in ipairs(state.entities) do\n"
+    "        parts[#parts + 1] = string.format('%.9g %.9g %.9g %.9g', e.x, e.y, e.vx, e.vy)\n"
+    "    end\n"
+    "    return table.concat(parts, '\\n')\n"
+    "end\n";
+
+static Engine engine = {NULL, false};
+
+// the engine keeps its native systems in statics, so the two instances take turns instead of running side by side
+static lua_State* open_instance(void)
+{
+    initialise_lua(&engine);
+    lua_State* L = engine.L;
+    if (luaL_loadstring(L, loopback_script) || lua_pcall(L, 0, 0, 0))
+    {
+        printf("Lua error: %s\n", lua_tostring(L, -1));
+        exit(1);
+    }
+    return L;
+}
+
+static bool call_with_integer(lua_State* L, const char* name, const int value, const int results)
+{
+    lua_getglobal(L, name);
+    lua_pushinteger(L, value);
+    if (lua_pcall(L, 1, results, 0))
+    {
+        printf("Lua error in %s(%d): %s\n", name, value, lua_tostring(L, -1));
+        lua_pop(L, 1);
+        return false;
+    }
+    return true;
+}
+
+static bool simulate(lua_State* L, const int frame)
+{
+    if (!call_with_integer(L, "step", frame, 0))
+        return false;
+
+    entity_update(1.0f / 60.0f);
+    return true;
+}
+
+// the raw entity store followed by the script digest, the script side is walked in a fixed order
+// since table iteration order is not guaranteed to survive a restore
+static bool capture(lua_State* L, SerialBuffer* out)
+{
+    SerialBuffer images = {0};
+    serial_buffer_clear(out);
+    entity_snapshot_save(out, &images);
+    entity_snapshot_release(L, &images);
+    serial_buffer_free(&images);
+
+    lua_getglobal(L, "digest");
+    if (lua_pcall(L, 0, 1, 0))
+    {
+        printf("Lua error in digest: %s\n", lua_tostring(L, -1));
+        lua_pop(L, 1);
+        return false;
+    }
+
+    size_t length = 0;
+    const char* digest = lua_tolstring(L, -1, &length);
+    serial_buffer_write(out, digest, length);
+    lua_pop(L, 1);
+    return true;
+}
+
+static bool matches(lua_State* L, const SerialBuffer* expected, SerialBuffer* scratch, const char* when, const int frame)
+{
+    if (!capture(L, scratch))
+        return false;
+
+    if (scratch->size != expected->size || memcmp(scratch->data, expected->data, expected->size) != 0)
+    {
+        printf("frame %d differs from the uninterrupted run %s\n", frame, when);
+        return false;
+    }
+    return true;
+}
+
+int main(const int argc, char** argv)
+{
+    const int frames = argc > 1 ? atoi(argv[1]) : DEFAULT_FRAMES;
+    if (argc > 2 || frames < 1)
+    {
+        printf("usage: %s [frames]\n", argv[0]);
+        return 1;
+    }
+
+    allocator_initialise(&engine.allocator);
+    SerialBuffer* reference = calloc(frames, sizeof(SerialBuffer));
+    SerialBuffer scratch = {0};
+    bool valid = true;
+
+    // MARK: Reference Instance
+
+    lua_State* L = open_instance();
+    for (int frame = 0; frame < frames && valid; ++frame)
+        valid = simulate(L, frame) && capture(L, &reference[frame]);
+    close_lua(&engine);
+
+    // MARK: Rollback Instance
+
+    int rollbacks = 0;
+    L = open_instance();
+    for (int frame = 0; frame < frames && valid; ++frame)
+    {
+        valid = simulate(L, frame) && call_with_integer(L, "snapshot_save", frame, 0);
+        if (!valid || frame < ROLLBACK_FRAMES || frame % ROLLBACK_INTERVAL != 0)
+            continue;
+
+        const int target = frame - ROLLBACK_FRAMES;
+        valid = call_with_integer(L, "snapshot_restore", target, 1) && lua_toboolean(L, -1);
+        lua_settop(L, 0);
+        if (!valid)
+        {
+            printf("frame %d could not be restored\n", target);
+            break;
+        }
+
+        rollbacks++;
+        valid = matches(L, &reference[target], &scratch, "after restoring it", target);
+
+        for (int replay = target + 1; replay <= frame && valid; ++replay)
+        {
+            valid = simulate(L, replay) && call_with_integer(L, "snapshot_save", replay, 0) &&
+                    matches(L, &reference[replay], &scratch, "after replaying it", replay);
+        }
+    }
+    close_lua(&engine);
+
+    for (int i = 0; i < frames; ++i)
+        serial_buffer_free(&reference[i]);
+    free(reference);
+    serial_buffer_free(&scratch);
+    allocator_destroy(&engine.allocator);
+
+    if (!valid)
+        return 1;
+
+    printf("%d frames with %d rollbacks of %d frames, every restored and replayed frame matches\n", frames, rollbacks,
+           ROLLBACK_FRAMES);
+    return 0;
+}
@@ -0,0 +1,504 @@
+#include "tween.h"
+#include "bindings.h"
+#include "frame.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+static Tween* tweens = NULL;
+static int capacity = 0;
+static int used = 0;
+static int free_head = -1;
+static int live_tweens = 0;
+
+// ids of tweens that reached their end during the native pass, completed once it is over
+static TweenId* finished = NULL;
+static int finished_count = 0;
+static int finished_capacity = 0;
+
+static const char* easing_names[] = {
+    "linear",
+    "quad_in", "quad_out", "quad_in_out",
+    "cubic_in", "cubic_out", "cubic_in_out",
+    "sine_in", "sine_out", "sine_in_out",
+    "back_out", "elastic_out", "bounce_out",
+    NULL
+};
+
+// MARK: Easing
+
+static float bounce_out(float t)
+{
+    if (t < 1.0f / 2.75f)
+        return 7.5625f * t * t;
+    if (t < 2.0f / 2.75f)
+    {
+        t -= 1.5f / 2.75f;
+        return 7.5625f * t * t + 0.75f;
+    }
+    if (t < 2.5f / 2.75f)
+    {
+        t -= 2.25f / 2.75f;
+        return 7.5625f * t * t + 0.9375f;
+    }
+    t -= 2.625f / 2.75f;
+    return 7.5625f * t * t + 0.984375f;
+}
+
+static float ease(const TweenEasing easing, const float t)
+{
+    const float u = 1.0f - t;
+    switch (easing)
+    {
+    case EASE_QUAD_IN:
+        return t * t;
+    case EASE_QUAD_OUT:
+        return 1.0f - u * u;
+    case EASE_QUAD_IN_OUT:
+        return t < 0.5f ? 2.0f * t * t : 1.0f - 2.0f * u * u;
+    case EASE_CUBIC_IN:
+        return t * t * t;
+    case EASE_CUBIC_OUT:
+        return 1.0f - u * u * u;
+    case EASE_CUBIC_IN_OUT:
+        return t < 0.5f ? 4.0f * t * t * t : 1.0f - 4.0f * u * u * u;
+    case EASE_SINE_IN:
+        return 1.0f - cosf(t * PI * 0.5f);
+    case EASE_SINE_OUT:
+        return sinf(t * PI * 0.5f);
+    case EASE_SINE_IN_OUT:
+        return 0.5f - cosf(t * PI) * 0.5f;
+    case EASE_BACK_OUT:
+        return 1.0f + 2.70158f * u * u * -u + 1.70158f * u * u;
+    case EASE_ELASTIC_OUT:
+        if (t <= 0.0f || t >= 1.0f)
+            return t;
+        return powf(2.0f, -10.0f * t) * sinf((t * 10.0f - 0.75f) * (2.0f * PI / 3.0f)) + 1.0f;
+    case EASE_BOUNCE_OUT:
+        return bounce_out(t);
+    default:
+        return t;
+    }
+}
+
+// MARK: Fields
+
+static float field_read(const Tween* tween)
+{
+    switch (tween->type)
+    {
+    case TWEEN_FLOAT_NEGATED:
+        return -*(float*)tween->field;
+    case TWEEN_BYTE:
+        return (float)*(unsigned char*)tween->field;
+    default:
+        return *(float*)tween->field;
+    }
+}
+
+static void field_write(const Tween* tween, const float value)
+{
+    switch (tween->type)
+    {
+    case TWEEN_FLOAT_NEGATED:
+        *(float*)tween->field = -value;
+        break;
+    case TWEEN_BYTE:
+        // overshooting curves like back_out would otherwise wrap around
+        *(unsigned char*)tween->field = (unsigned char)(value <= 0.0f ? 0.0f : value >= 255.0f ? 255.0f : value + 0.5f);
+        break;
+    default:
+        *(float*)tween->field = value;
+        break;
+    }
+}
+
+static bool has_metatable(lua_State* L, const int idx, const char* name)
+{
+    if (!lua_getmetatable(L, idx))
+        return false;
+
+    luaL_getmetatable(L, name);
+    const bool equal = lua_rawequal(L, -1, -2);
+    lua_pop(L, 2);
+    return equal;
+}
+
+// resolves a field of a rect, color or camera to the memory a tween writes every frame
+static void* check_field(lua_State* L, const int idx, const char* key, TweenFieldType* type)
+{
+    void* target = lua_touserdata(L, idx);
+    *type = TWEEN_FLOAT;
+
+    if (target != NULL && has_metatable(L, idx, "__mt_rect"))
+    {
+        Rectangle* rect = target;
+        if (strcmp(key, "x") == 0)
+            return &rect->x;
+        if (strcmp(key, "y") == 0)
+            return &rect->y;
+        if (strcmp(key, "width") == 0)
+            return &rect->width;
+        if (strcmp(key, "height") == 0)
+            return &rect->height;
+        luaL_error(L, "Rect has no field \"%s\".", key);
+    }
+    else if (target != NULL && has_metatable(L, idx, "__mt_color"))
+    {
+        Color* color = target;
+        *type = TWEEN_BYTE;
+        if (strcmp(key, "r") == 0)
+            return &color->r;
+        if (strcmp(key, "g") == 0)
+            return &color->g;
+        if (strcmp(key, "b") == 0)
+            return &color->b;
+        if (strcmp(key, "a") == 0)
+            return &color->a;
+        luaL_error(L, "Color has no field \"%s\".", key);
+    }
+    else if (target != NULL && has_metatable(L, idx, "__mt_camera"))
+    {
+        Camera2D* cam = target;
+        if (strcmp(key, "rotation") == 0)
+            return &cam->rotation;
+        if (strcmp(key, "zoom") == 0)
+            return &cam->zoom;
+
+        *type = TWEEN_FLOAT_NEGATED;
+        if (strcmp(key, "x") == 0)
+            return &cam->offset.x;
+        if (strcmp(key, "y") == 0)
+            return &cam->offset.y;
+        luaL_error(L, "Camera has no field \"%s\".", key);
+    }
+    else
+    {
+        luaL_error(L, "argument \"target\" is not a rect, color or camera value");
+    }
+
+    return NULL;
+}
+
+// MARK: Pool
+
+static TweenId tween_id(const int index)
+{
+    return (TweenId)tweens[index].generation << TWEEN_INDEX_BITS | (TweenId)index;
+}
+
+// returns the pool index of a live tween, or -1 once it has finished or been cancelled
+static int tween_resolve(const TweenId id)
+{
+    const int index = (int)(id & TWEEN_INDEX_MASK);
+    if (index >= used || tweens[index].state == TWEEN_FREE)
+        return -1;
+    if ((TweenId)tweens[index].generation != id >> TWEEN_INDEX_BITS)
+        return -1;
+    return index;
+}
+
+static int tween_alloc(void)
+{
+    if (free_head >= 0)
+    {
+        const int index = free_head;
+        free_head = tweens[index].next_free;
+        return index;
+    }
+
+    if (used == TWEEN_MAX_COUNT)
+        return -1;
+
+    if (used == capacity)
+    {
+        capacity = capacity > 0 ? capacity * 2 : 64;
+        tweens = realloc(tweens, capacity * sizeof(Tween));
+    }
+
+    tweens[used].generation = 0;
+    return used++;
+}
+
+static void tween_release(lua_State* L, const int index)
+{
+    Tween* tween = &tweens[index];
+    luaL_unref(L, LUA_REGISTRYINDEX, tween->target_ref);
+    luaL_unref(L, LUA_REGISTRYINDEX, tween->callback_ref);
+
+    tween->state = TWEEN_FREE;
+    tween->generation++;
+    tween->next_free = free_head;
+    free_head = index;
+    live_tweens--;
+}
+
+static void tween_start(const int index)
+{
+    // the start value is read when the tween begins, so a sequence picks up where the previous step left off
+    Tween* tween = &tweens[index];
+    tween->state = TWEEN_RUNNING;
+    tween->leader = -1;
+    tween->from = field_read(tween);
+    tween->elapsed = 0.0f;
+}
+
+static void unlink_follower(const int index)
+{
+    const int leader = tweens[index].leader;
+    int* link = &tweens[leader].first_follower;
+    while (*link != index)
+        link = &tweens[*link].next_follower;
+    *link = tweens[index].next_follower;
+}
+
+// followers only exist to run after this tween, so cancelling it cancels them too
+static void tween_cancel(lua_State* L, const int index)
+{
+    if (tweens[index].leader >= 0)
+        unlink_follower(index);
+
+    int follower = tweens[index].first_follower;
+    tweens[index].first_follower = -1;
+    while (follower >= 0)
+    {
+        const int next = tweens[follower].next_follower;
+        tweens[follower].leader = -1;
+        tween_cancel(L, follower);
+        follower = next;
+    }
+
+    tween_release(L, index);
+}
+
+static void tween_complete(lua_State* L, const int index)
+{
+    Tween* tween = &tweens[index];
+    const int callback_ref = tween->callback_ref;
+    tween->callback_ref = LUA_NOREF;
+
+    int follower = tween->first_follower;
+    while (follower >= 0)
+    {
+        const int next = tweens[follower].next_follower;
+        tween_start(follower);
+        follower = next;
+    }
+
+    tween_release(L, index);
+
+    // the callback may create or cancel tweens, so nothing above holds on to the pool across it
+    if (callback_ref != LUA_NOREF)
+    {
+        lua_rawgeti(L, LUA_REGISTRYINDEX, callback_ref);
+        luaL_unref(L, LUA_REGISTRYINDEX, callback_ref);
+        if (lua_pcall(L, 0, 0, 0))
+        {
+            printf("Lua error in tween callback: %s\n", lua_tostring(L, -1));
+            lua_pop(L, 1);
+        }
+    }
+}
+
+void tween_update(lua_State* L, const float dt)
+{
+    finished_count = 0;
+
+    // the whole pass is native, scripts only run for tweens that finished
+    for (int i = 0; i < used; ++i)
+    {
+        Tween* tween = &tweens[i];
+        if (tween->state != TWEEN_RUNNING)
+            continue;
+
+        tween->elapsed += dt;
+        float t = tween->duration > 0.0f ? tween->elapsed / tween->duration : 1.0f;
+        if (t >= 1.0f)
+        {
+            t = 1.0f;
+            if (finished_count == finished_capacity)
+            {
+                finished_capacity = finished_capacity > 0 ? finished_capacity * 2 : 64;
+                finished = realloc(finished, finished_capacity * sizeof(TweenId));
+            }
+            finished[finished_count++] = tween_id(i);
+        }
+
+        field_write(tween, tween->from + (tween->to - tween->from) * ease(tween->easing, t));
+    }
+
+    // an earlier callback may have cancelled a later tween, so each one is resolved again
+    for (int i = 0; i < finished_count; ++i)
+    {
+        const int index = tween_resolve(finished[i]);
+        if (index >= 0)
+            tween_complete(L, index);
+    }
+
+    // queued tweens always wait behind a running one, so live tweens mean the next frame is needed
+    if (live_tweens > 0)
+        frame_request();
+}
+
+void tween_reset(void)
+{
+    // the registry references died with the state, the pool memory is kept for the next one
+    used = 0;
+    free_head = -1;
+    live_tweens = 0;
+    finished_count = 0;
+}
+
+// MARK: Lua Functions
+
+static TweenId check_id(lua_State* L, const int idx)
+{
+    // anything that could not have come from tween_id maps to a generation no slot can have
+    const lua_Number value = luaL_checknumber(L, idx);
+    if (!(value >= 0 && value < (lua_Number)((TweenId)1 << 52)))
+        return (TweenId)1 << 52;
+    return (TweenId)value;
+}
+
+// target, field, to, duration, easing and callback starting at first
+static int create_tween(lua_State* L, const int first, const int leader)
+{
+    const char* key = luaL_checkstring(L, first + 1);
+    TweenFieldType type;
+    void* field = check_field(L, first, key, &type);
+    const lua_Number to = luaL_checknumber(L, first + 2);
+    const lua_Number duration = luaL_checknumber(L, first + 3);
+    const int easing = luaL_checkoption(L, first + 4, "linear", easing_names);
+    luaL_argcheck(L, duration >= 0, first + 3, "duration must not be negative");
+    if (!lua_isnoneornil(L, first + 5))
+        luaL_checktype(L, first + 5, LUA_TFUNCTION);
+
+    const int index = tween_alloc();
+    if (index < 0)
+        return luaL_error(L, "tween limit of %d reached", TWEEN_MAX_COUNT);
+
+    Tween* tween = &tweens[index];
+    tween->field = field;
+    tween->type = type;
+    tween->easing = (TweenEasing)easing;
+    tween->to = (float)to;
+    tween->duration = (float)duration;
+    tween->target = lua_touserdata(L, first);
+    tween->first_follower = -1;
+    tween->next_follower = -1;
+    tween->leader = -1;
+
+    lua_pushvalue(L, first);
+    tween->target_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+
+    if (lua_isnoneornil(L, first + 5))
+    {
+        tween->callback_ref = LUA_NOREF;
+    }
+    else
+    {
+        lua_pushvalue(L, first + 5);
+        tween->callback_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+    }
+
+    live_tweens++;
+
+    if (leader >= 0)
+    {
+        // appended so tweens queued behind the same leader start in the order they were queued
+        tween->state = TWEEN_WAITING;
+        tween->leader = leader;
+        int* link = &tweens[leader].first_follower;
+        while (*link >= 0)
+            link = &tweens[*link].next_follower;
+        *link = index;
+    }
+    else
+    {
+        tween_start(index);
+    }
+
+    lua_pushnumber(L, (lua_Number)tween_id(index));
+    return 1;
+}
+
+static int cmt_tween(lua_State* L)
+{
+    return create_tween(L, 1, -1);
+}
+
+static int cmt_tween_after(lua_State* L)
+{
+    // queuing behind a tween that already ended starts right away
+    const TweenId previous = check_id(L, 1);
+    return create_tween(L, 2, tween_resolve(previous));
+}
+
+static int cmt_tween_cancel(lua_State* L)
+{
+    const TweenId id = check_id(L, 1);
+    const bool finish = lua_toboolean(L, 2);
+
+    const int index = tween_resolve(id);
+    if (index < 0)
+    {
+        lua_pushboolean(L, false);
+        return 1;
+    }
+
+    if (finish && tweens[index].state == TWEEN_RUNNING)
+    {
+        // jumps to the end value and completes as if the tween had run out
+        field_write(&tweens[index], tweens[index].to);
+        tween_complete(L, index);
+    }
+    else
+    {
+        tween_cancel(L, index);
+    }
+
+    lua_pushboolean(L, true);
+    return 1;
+}
+
+static int cmt_tween_cancel_target(lua_State* L)
+{
+    luaL_checktype(L, 1, LUA_TUSERDATA);
+    const void* target = lua_touserdata(L, 1);
+
+    int cancelled = 0;
+    for (int i = 0; i < used; ++i)
+    {
+        if (tweens[i].state != TWEEN_FREE && tweens[i].target == target)
+        {
+            tween_cancel(L, i);
+            cancelled++;
+        }
+    }
+
+    lua_pushinteger(L, cancelled);
+    return 1;
+}
+
+static int cmt_tween_active(lua_State* L)
+{
+    const TweenId id = check_id(L, 1);
+    lua_pushboolean(L, tween_resolve(id) >= 0);
+    return 1;
+}
+
+static int cmt_tween_count(lua_State* L)
+{
+    lua_pushinteger(L, live_tweens);
+    return 1;
+}
+
+void register_tween_bindings(lua_State* L)
+{
+    lua_register(L, "tween", cmt_tween);
+    lua_register(L, "tween_after", cmt_tween_after);
+    lua_register(L, "tween_cancel", cmt_tween_cancel);
+    lua_register(L, "tween_cancel_target", cmt_tween_cancel_target);
+    lua_register(L, "tween_active", cmt_tween_active);
+    lua_register(L, "tween_count", cmt_tween_count);
+}
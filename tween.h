@@ -0,0 +1,85 @@
+#ifndef TWEEN_H
+#define TWEEN_H
+
+#include <stdint.h>
+#include "comet.h"
+
+// ids pack a pool index with a full 32 bit generation so finished or cancelled tweens can be detected,
+// the 52 bits still fit exactly in the double they are handed to scripts as
+#define TWEEN_INDEX_BITS 20
+#define TWEEN_INDEX_MASK ((1u << TWEEN_INDEX_BITS) - 1)
+#define TWEEN_MAX_COUNT (1 << TWEEN_INDEX_BITS)
+
+typedef uint64_t TweenId;
+
+typedef enum TweenEasing
+{
+    EASE_LINEAR,
+    EASE_QUAD_IN,
+    EASE_QUAD_OUT,
+    EASE_QUAD_IN_OUT,
+    EASE_CUBIC_IN,
+    EASE_CUBIC_OUT,
+    EASE_CUBIC_IN_OUT,
+    EASE_SINE_IN,
+    EASE_SINE_OUT,
+    EASE_SINE_IN_OUT,
+    EASE_BACK_OUT,
+    EASE_ELASTIC_OUT,
+    EASE_BOUNCE_OUT,
+    EASE_COUNT
+} TweenEasing;
+
+typedef enum TweenFieldType
+{
+    TWEEN_FLOAT,
+    // camera x and y are exposed to scripts as the negated offset
+    TWEEN_FLOAT_NEGATED,
+    TWEEN_BYTE
+} TweenFieldType;
+
+typedef enum TweenState
+{
+    TWEEN_FREE,
+    // queued behind another tween with tween_after
+    TWEEN_WAITING,
+    TWEEN_RUNNING
+} TweenState;
+
+typedef struct Tween
+{
+    // points into the target userdata, which is kept alive through target_ref
+    void* field;
+    TweenFieldType type;
+    TweenState state;
+    TweenEasing easing;
+
+    float from;
+    float to;
+    float duration;
+    float elapsed;
+
+    int target_ref;
+    int callback_ref;
+
+    // identity of the target userdata, used to cancel everything running on one object
+    const void* target;
+
+    // tweens queued to start when this one finishes, and the tween a waiting one is queued behind
+    int first_follower;
+    int next_follower;
+    int leader;
+
+    uint32_t generation;
+    int next_free;
+} Tween;
+
+// advances every running tween, then calls completion callbacks and starts the tweens queued behind them
+void tween_update(lua_State* L, float dt);
+
+// drops all tweens, used when the Lua state they belong to is closed
+void tween_reset(void);
+
+void register_tween_bindings(lua_State* L);
+
+#endif //TWEEN_H
@@ -0,0 +1,189 @@
+#include "lz4.h"
+#include <stdint.h>
+#include <string.h>
+
+#define LZ4_HASH_LOG 12
+#define LZ4_MIN_MATCH 4
+#define LZ4_MAX_DISTANCE 65535
+
+// the format requires the last five bytes to be literals and the last match to start twelve bytes before the end
+#define LZ4_LAST_LITERALS 5
+#define LZ4_MATCH_LIMIT 12
+
+static uint32_t read_u32(const unsigned char* p)
+{
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static uint32_t hash_sequence(const uint32_t sequence)
+{
+    return (sequence * 2654435761u) >> (32 - LZ4_HASH_LOG);
+}
+
+size_t lz4_compress_bound(const size_t size)
+{
+    return size + size / 255 + 16;
+}
+
+// writes the 15+ continuation of a length field
+static unsigned char* write_length(unsigned char* op, size_t length)
+{
+    while (length >= 255)
+    {
+        *op++ = 255;
+        length -= 255;
+    }
+    *op++ = (unsigned char)length;
+    return op;
+}
+
+static unsigned char* write_sequence(unsigned char* op, const unsigned char* dst_end, const unsigned char* literals,
+                                     const size_t literal_length, const size_t offset, const size_t match_length)
+{
+    // token, both length continuations, the literals and the offset, checked once up front
+    const size_t worst = 1 + literal_length / 255 + 1 + literal_length + 2 + match_length / 255 + 1;
+    if (worst > (size_t)(dst_end - op))
+        return NULL;
+
+    unsigned char* token = op++;
+    *token = (unsigned char)((literal_length >= 15 ? 15 : literal_length) << 4);
+    if (literal_length >= 15)
+        op = write_length(op, literal_length - 15);
+
+    memcpy(op, literals, literal_length);
+    op += literal_length;
+
+    // the last sequence only carries literals
+    if (match_length == 0)
+        return op;
+
+    *op++ = (unsigned char)(offset & 0xff);
+    *op++ = (unsigned char)(offset >> 8);
+
+    const size_t match_code = match_length - LZ4_MIN_MATCH;
+    *token |= (unsigned char)(match_code >= 15 ? 15 : match_code);
+    if (match_code >= 15)
+        op = write_length(op, match_code - 15);
+
+    return op;
+}
+
+size_t lz4_compress(const unsigned char* src, const size_t src_size, unsigned char* dst, const size_t capacity)
+{
+    // positions are stored off by one so a zeroed table means empty
+    uint32_t table[1 << LZ4_HASH_LOG];
+    memset(table, 0, sizeof(table));
+
+    unsigned char* op = dst;
+    const unsigned char* dst_end = dst + capacity;
+    size_t anchor = 0;
+    size_t ip = 0;
+
+    if (src_size > LZ4_MATCH_LIMIT)
+    {
+        const size_t search_limit = src_size - LZ4_MATCH_LIMIT;
+        const size_t match_end_limit = src_size - LZ4_LAST_LITERALS;
+
+        while (ip < search_limit)
+        {
+            const uint32_t sequence = read_u32(src + ip);
+            const uint32_t hash = hash_sequence(sequence);
+            const size_t candidate = table[hash];
+            table[hash] = (uint32_t)(ip + 1);
+
+            if (candidate == 0 || ip - (candidate - 1) > LZ4_MAX_DISTANCE || read_u32(src + candidate - 1) != sequence)
+            {
+                ip++;
+                continue;
+            }
+
+            const size_t reference = candidate - 1;
+            size_t match_length = LZ4_MIN_MATCH;
+            while (ip + match_length < match_end_limit && src[reference + match_length] == src[ip + match_length])
+                match_length++;
+
+            op = write_sequence(op, dst_end, src + anchor, ip - anchor, ip - reference, match_length);
+            if (op == NULL)
+                return 0;
+
+            ip += match_length;
+            anchor = ip;
+        }
+    }
+
+    op = write_sequence(op, dst_end, src + anchor, src_size - anchor, 0, 0);
+    if (op == NULL)
+        return 0;
+
+    return (size_t)(op - dst);
+}
+
+static int read_length(const unsigned char** ip, const unsigned char* end, size_t* length)
+{
+    unsigned char byte;
+    do
+    {
+        if (*ip >= end)
+            return 0;
+        byte = *(*ip)++;
+        *length += byte;
+    } while (byte == 255);
+    return 1;
+}
+
+int lz4_decompress(const unsigned char* src, const size_t src_size, unsigned char* dst, const size_t dst_size)
+{
+    const unsigned char* ip = src;
+    const unsigned char* end = src + src_size;
+    size_t op = 0;
+
+    while (ip < end)
+    {
+        const unsigned char token = *ip++;
+
+        size_t literal_length = token >> 4;
+        if (literal_length == 15 && !read_length(&ip, end, &literal_length))
+            return 0;
+        if (literal_length > (size_t)(end - ip) || literal_length > dst_size - op)
+            return 0;
+
+        memcpy(dst + op, ip, literal_length);
+        ip += literal_length;
+        op += literal_length;
+
+        // the block ends after the literals of its last sequence
+        if (ip == end)
+            break;
+
+        if (end - ip < 2)
+            return 0;
+        const size_t offset = (size_t)ip[0] | (size_t)ip[1] << 8;
+        ip += 2;
+        if (offset == 0 || offset > op)
+            return 0;
+
+        size_t match_length = token & 15;
+        if (match_length == 15 && !read_length(&ip, end, &match_length))
+            return 0;
+        match_length += LZ4_MIN_MATCH;
+        if (match_length > dst_size - op)
+            return 0;
+
+        // matches may overlap the bytes they produce, so short offsets have to copy forwards one byte at a time
+        const unsigned char* match = dst + op - offset;
+        if (offset >= match_length)
+        {
+            memcpy(dst + op, match, match_length);
+        }
+        else
+        {
+            for (size_t i = 0; i < match_length; ++i)
+                dst[op + i] = match[i];
+        }
+        op += match_length;
+    }
+
+    return op == dst_size;
+}
@@ -0,0 +1,17 @@
+#ifndef LZ4_H
+#define LZ4_H
+
+#include <stddef.h>
+
+// raw LZ4 block format, without the frame header, checksums or dictionaries
+
+// the largest output lz4_compress can produce for an input of this size
+size_t lz4_compress_bound(size_t size);
+
+// returns the compressed size, or 0 when the output does not fit in capacity
+size_t lz4_compress(const unsigned char* src, size_t src_size, unsigned char* dst, size_t capacity);
+
+// decodes into a buffer of exactly the original size, returns false for malformed or truncated input
+int lz4_decompress(const unsigned char* src, size_t src_size, unsigned char* dst, size_t dst_size);
+
+#endif //LZ4_H
@@ -0,0 +1,165 @@
+#include "watchdog.h"
+#include "hooks.h"
+#include <string.h>
+
+static CallbackTiming callbacks[WATCHDOG_MAX_CALLBACKS];
+static int callback_count = 0;
+
+// the callback being timed, NULL while no Lua code is running on behalf of the engine
+static CallbackTiming* current = NULL;
+static double start_time = 0;
+static bool warned = false;
+static bool tripped = false;
+
+// limits in milliseconds, 0 turns a limit off
+static double soft_limit = 0;
+static double hard_limit = WATCHDOG_DEFAULT_HARD_LIMIT;
+
+static lua_State* main_state = NULL;
+
+static CallbackTiming* find_callback(const char* name)
+{
+    for (int i = 0; i < callback_count; ++i)
+    {
+        if (strcmp(callbacks[i].name, name) == 0)
+            return &callbacks[i];
+    }
+
+    if (callback_count == WATCHDOG_MAX_CALLBACKS)
+        return NULL;
+
+    CallbackTiming* timing = &callbacks[callback_count++];
+    memset(timing, 0, sizeof(CallbackTiming));
+    timing->name = name;
+    return timing;
+}
+
+static void print_stack(lua_State* L)
+{
+    lua_Debug ar;
+    for (int level = 0; lua_getstack(L, level, &ar); ++level)
+    {
+        lua_getinfo(L, "Sln", &ar);
+        printf("    %s:%d in %s\n", ar.short_src, ar.currentline, ar.name != NULL ? ar.name : "?");
+    }
+}
+
+static void watchdog_hook(lua_State* L)
+{
+    if (current == NULL)
+        return;
+
+    const double elapsed = (GetTime() - start_time) * 1000.0;
+
+    if (hard_limit > 0 && elapsed > hard_limit)
+    {
+        if (!tripped)
+        {
+            tripped = true;
+            current->hard_hits++;
+            printf("Watchdog: %s exceeded the hard limit of %.1f ms\n", current->name, hard_limit);
+            print_stack(L);
+        }
+
+        // raised on every check until the callback returns, so a pcall in the script cannot swallow it
+        luaL_error(L, "%s was aborted by the watchdog after %.1f ms", current->name, elapsed);
+    }
+
+    if (soft_limit > 0 && elapsed > soft_limit && !warned)
+    {
+        warned = true;
+        current->soft_hits++;
+        printf("Watchdog: %s exceeded the soft limit of %.1f ms\n", current->name, soft_limit);
+        print_stack(L);
+    }
+}
+
+static void apply_limits(void)
+{
+    if (main_state == NULL)
+        return;
+
+    // the hook is only needed while there is a limit to enforce, timing works without it
+    if (soft_limit > 0 || hard_limit > 0)
+        hooks_set(main_state, HOOK_WATCHDOG, watchdog_hook, WATCHDOG_CHECK_INTERVAL);
+    else
+        hooks_set(main_state, HOOK_WATCHDOG, NULL, 0);
+}
+
+void watchdog_begin(const char* name)
+{
+    current = find_callback(name);
+    start_time = GetTime();
+    warned = false;
+    tripped = false;
+}
+
+bool watchdog_end(void)
+{
+    if (current == NULL)
+        return false;
+
+    const double elapsed = (GetTime() - start_time) * 1000.0;
+    current->last = elapsed;
+    current->total += elapsed;
+    current->calls++;
+    if (elapsed > current->max)
+        current->max = elapsed;
+
+    current = NULL;
+    return tripped;
+}
+
+// MARK: Lua Functions
+
+static int cmt_watchdog_limits(lua_State* L)
+{
+    const lua_Number soft = luaL_optnumber(L, 1, 0);
+    const lua_Number hard = luaL_optnumber(L, 2, 0);
+    luaL_argcheck(L, soft >= 0, 1, "soft limit cannot be negative");
+    luaL_argcheck(L, hard >= 0, 2, "hard limit cannot be negative");
+
+    soft_limit = soft;
+    hard_limit = hard;
+    apply_limits();
+    return 0;
+}
+
+static int cmt_watchdog_stats(lua_State* L)
+{
+    lua_createtable(L, 0, callback_count);
+
+    for (int i = 0; i < callback_count; ++i)
+    {
+        const CallbackTiming* timing = &callbacks[i];
+        lua_createtable(L, 0, 6);
+
+        lua_pushnumber(L, timing->last);
+        lua_setfield(L, -2, "last");
+        lua_pushnumber(L, timing->max);
+        lua_setfield(L, -2, "max");
+        lua_pushnumber(L, timing->calls > 0 ? timing->total / (double)timing->calls : 0);
+        lua_setfield(L, -2, "average");
+        lua_pushnumber(L, (lua_Number)timing->calls);
+        lua_setfield(L, -2, "calls");
+        lua_pushnumber(L, (lua_Number)timing->soft_hits);
+        lua_setfield(L, -2, "soft_hits");
+        lua_pushnumber(L, (lua_Number)timing->hard_hits);
+        lua_setfield(L, -2, "hard_hits");
+
+        lua_setfield(L, -2, timing->name);
+    }
+
+    return 1;
+}
+
+void register_watchdog_bindings(lua_State* L)
+{
+    // limits outlive the state so they stay in place across a restart
+    main_state = L;
+    current = NULL;
+    apply_limits();
+
+    lua_register(L, "watchdog_limits", cmt_watchdog_limits);
+    lua_register(L, "watchdog_stats", cmt_watchdog_stats);
+}
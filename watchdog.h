@@ -0,0 +1,29 @@
+#ifndef WATCHDOG_H
+#define WATCHDOG_H
+
+#include "comet.h"
+
+#define WATCHDOG_MAX_CALLBACKS 16
+#define WATCHDOG_CHECK_INTERVAL 1000
+#define WATCHDOG_DEFAULT_HARD_LIMIT 5000.0
+
+// time spent in one named entry point from C into Lua, in milliseconds
+typedef struct CallbackTiming
+{
+    const char* name;
+    double last;
+    double max;
+    double total;
+    unsigned long calls;
+    unsigned long soft_hits;
+    unsigned long hard_hits;
+} CallbackTiming;
+
+// wraps a call into Lua, the hook raises an error in it once the hard limit is exceeded
+void watchdog_begin(const char* name);
+// returns true when the hard limit was hit, in which case the script should be stopped
+bool watchdog_end(void);
+
+void register_watchdog_bindings(lua_State* L);
+
+#endif //WATCHDOG_H
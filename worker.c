@@ -0,0 +1,408 @@
+#include "worker.h"
+#include "frame.h"
+#include "pack.h"
+#include "serialize.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if !defined(__EMSCRIPTEN__) || defined(__EMSCRIPTEN_PTHREADS__)
+#define WORKERS_SUPPORTED 1
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#endif
+
+#ifdef WORKERS_SUPPORTED
+
+// MARK: Queues
+
+static bool queue_push(WorkerQueue* queue, WorkerMessage* message)
+{
+    const unsigned int tail = __atomic_load_n(&queue->tail, __ATOMIC_RELAXED);
+    const unsigned int head = __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+    if (tail - head == WORKER_QUEUE_CAPACITY)
+        return false;
+
+    queue->slots[tail % WORKER_QUEUE_CAPACITY] = message;
+    __atomic_store_n(&queue->tail, tail + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+static WorkerMessage* queue_pop(WorkerQueue* queue)
+{
+    const unsigned int head = __atomic_load_n(&queue->head, __ATOMIC_RELAXED);
+    const unsigned int tail = __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE);
+    if (head == tail)
+        return NULL;
+
+    WorkerMessage* message = queue->slots[head % WORKER_QUEUE_CAPACITY];
+    __atomic_store_n(&queue->head, head + 1, __ATOMIC_RELEASE);
+    return message;
+}
+
+static void queue_clear(WorkerQueue* queue)
+{
+    WorkerMessage* message;
+    while ((message = queue_pop(queue)) != NULL)
+        free(message);
+}
+
+// MARK: Messages
+
+static WorkerMessage* encode_message(lua_State* L, const int idx)
+{
+    SerialBuffer buffer = {0};
+    const char* error = serialize_value(L, idx, &buffer);
+    if (error != NULL)
+    {
+        serial_buffer_free(&buffer);
+        luaL_error(L, "%s", error);
+        return NULL;
+    }
+
+    WorkerMessage* message = malloc(sizeof(WorkerMessage) + buffer.size);
+    message->size = buffer.size;
+    memcpy(message->data, buffer.data, buffer.size);
+    serial_buffer_free(&buffer);
+    return message;
+}
+
+// pushes the decoded message, leaves the stack unchanged on failure
+static bool decode_message(lua_State* L, const WorkerMessage* message)
+{
+    return deserialize_value(L, message->data, message->size);
+}
+
+// MARK: Worker Threads
+
+typedef struct Worker
+{
+    pthread_t thread;
+    char script_path[512];
+    WorkerQueue inbox;
+    WorkerQueue outbox;
+    // signalled when the inbox gets a message or the worker is asked to stop
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    volatile int running;
+    volatile int failed;
+    char error[256];
+} Worker;
+
+typedef struct WorkerHandle
+{
+    Worker* worker;
+} WorkerHandle;
+
+// instructions between checks for a stop request, often enough to stop promptly without slowing scripts down
+#define WORKER_HOOK_COUNT 10000
+
+static void worker_wake(Worker* worker)
+{
+    pthread_mutex_lock(&worker->lock);
+    pthread_cond_signal(&worker->wake);
+    pthread_mutex_unlock(&worker->lock);
+}
+
+// blocks until the inbox has a message, the worker is stopped or the deadline passes, a NULL deadline waits forever
+static void worker_wait(Worker* worker, const struct timespec* deadline)
+{
+    pthread_mutex_lock(&worker->lock);
+    while (__atomic_load_n(&worker->running, __ATOMIC_ACQUIRE)
+        && __atomic_load_n(&worker->inbox.head, __ATOMIC_RELAXED) == __atomic_load_n(&worker->inbox.tail, __ATOMIC_ACQUIRE))
+    {
+        if (deadline == NULL)
+            pthread_cond_wait(&worker->wake, &worker->lock);
+        else if (pthread_cond_timedwait(&worker->wake, &worker->lock, deadline) == ETIMEDOUT)
+            break;
+    }
+    pthread_mutex_unlock(&worker->lock);
+}
+
+static void worker_fail(Worker* worker, lua_State* L)
+{
+    // the error raised by the hook when the worker is stopped is not a script failure
+    if (!__atomic_load_n(&worker->running, __ATOMIC_ACQUIRE))
+        return;
+
+    snprintf(worker->error, sizeof(worker->error), "%s", lua_tostring(L, -1));
+    printf("Lua worker error: %s\n", worker->error);
+    __atomic_store_n(&worker->failed, 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&worker->running, 0, __ATOMIC_RELEASE);
+
+    // a reactive main state only notices the failure on a frame that runs
+    frame_request();
+}
+
+static int cmt_worker_post(lua_State* L)
+{
+    Worker* worker = lua_touserdata(L, lua_upvalueindex(1));
+    luaL_checkany(L, 1);
+
+    WorkerMessage* message = encode_message(L, 1);
+    const bool sent = queue_push(&worker->outbox, message);
+    if (sent)
+        frame_request();
+    else
+        free(message);
+
+    lua_pushboolean(L, sent);
+    return 1;
+}
+
+static int cmt_worker_receive_inbox(lua_State* L)
+{
+    Worker* worker = lua_touserdata(L, lua_upvalueindex(1));
+    const double timeout = luaL_optnumber(L, 1, 0.0);
+    luaL_argcheck(L, timeout >= 0.0, 1, "timeout must not be negative");
+
+    WorkerMessage* message = queue_pop(&worker->inbox);
+    if (message == NULL && timeout > 0.0)
+    {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        const double seconds = (double)deadline.tv_sec + (double)deadline.tv_nsec / 1e9 + timeout;
+        deadline.tv_sec = (time_t)seconds;
+        deadline.tv_nsec = (long)((seconds - (double)deadline.tv_sec) * 1e9);
+
+        worker_wait(worker, &deadline);
+        message = queue_pop(&worker->inbox);
+    }
+    if (message == NULL)
+        return 0;
+
+    const bool decoded = decode_message(L, message);
+    free(message);
+    return decoded ? 1 : 0;
+}
+
+static void open_worker_libs(lua_State* L, Worker* worker)
+{
+    // pure libraries only, workers have no access to the engine, files or the OS
+    const lua_CFunction libs[] = {luaopen_base, luaopen_table, luaopen_string, luaopen_math};
+    for (size_t i = 0; i < sizeof(libs) / sizeof(libs[0]); ++i)
+    {
+        lua_pushcfunction(L, libs[i]);
+        lua_call(L, 0, 0);
+    }
+
+    lua_pushnil(L);
+    lua_setglobal(L, "dofile");
+    lua_pushnil(L);
+    lua_setglobal(L, "loadfile");
+
+    lua_pushlightuserdata(L, worker);
+    lua_pushcclosure(L, cmt_worker_post, 1);
+    lua_setglobal(L, "post");
+
+    lua_pushlightuserdata(L, worker);
+    lua_pushcclosure(L, cmt_worker_receive_inbox, 1);
+    lua_setglobal(L, "receive");
+}
+
+// a worker stuck in a loop or a long computation would otherwise hang whoever stops it
+static void worker_hook(lua_State* L, lua_Debug* ar)
+{
+    (void)ar;
+    lua_getfield(L, LUA_REGISTRYINDEX, "__worker");
+    const Worker* worker = lua_touserdata(L, -1);
+    lua_pop(L, 1);
+
+    if (!__atomic_load_n(&worker->running, __ATOMIC_ACQUIRE))
+        luaL_error(L, "worker stopped");
+}
+
+static void* worker_main(void* arg)
+{
+    Worker* worker = arg;
+
+    // the worker owns its state and allocator, nothing in it is shared with the main thread
+    Allocator allocator;
+    allocator_initialise(&allocator);
+    lua_State* L = lua_newstate(allocator_lua_alloc, &allocator);
+    open_worker_libs(L, worker);
+
+    lua_pushlightuserdata(L, worker);
+    lua_setfield(L, LUA_REGISTRYINDEX, "__worker");
+    lua_sethook(L, worker_hook, LUA_MASKCOUNT, WORKER_HOOK_COUNT);
+
+    if (pack_load_lua(L, worker->script_path) || lua_pcall(L, 0, 0, 0))
+        worker_fail(worker, L);
+
+    while (__atomic_load_n(&worker->running, __ATOMIC_ACQUIRE))
+    {
+        WorkerMessage* message = queue_pop(&worker->inbox);
+        if (message == NULL)
+        {
+            worker_wait(worker, NULL);
+            continue;
+        }
+
+        lua_getglobal(L, "on_message");
+        const bool handler = lua_isfunction(L, -1);
+        const bool decoded = handler && decode_message(L, message);
+        free(message);
+
+        if (!decoded)
+        {
+            lua_settop(L, 0);
+            continue;
+        }
+
+        if (lua_pcall(L, 1, 0, 0))
+        {
+            worker_fail(worker, L);
+            break;
+        }
+    }
+
+    lua_close(L);
+    allocator_destroy(&allocator);
+    return NULL;
+}
+
+static void worker_stop(Worker* worker)
+{
+    __atomic_store_n(&worker->running, 0, __ATOMIC_RELEASE);
+    worker_wake(worker);
+    pthread_join(worker->thread, NULL);
+    queue_clear(&worker->inbox);
+    queue_clear(&worker->outbox);
+    pthread_cond_destroy(&worker->wake);
+    pthread_mutex_destroy(&worker->lock);
+    free(worker);
+}
+
+// MARK: Lua Functions
+
+static WorkerHandle* cmt_check_worker(lua_State* L, const int idx)
+{
+    WorkerHandle* handle = luaL_checkudata(L, idx, "__mt_worker");
+    if (handle->worker == NULL)
+        luaL_error(L, "Worker has been stopped.");
+    return handle;
+}
+
+static int cmt_worker_spawn(lua_State* L)
+{
+    const char* script_path = luaL_checkstring(L, 1);
+    luaL_argcheck(L, strlen(script_path) < sizeof(((Worker*)NULL)->script_path), 1, "path is too long");
+
+    WorkerHandle* handle = lua_newuserdata(L, sizeof(WorkerHandle));
+    handle->worker = NULL;
+    luaL_getmetatable(L, "__mt_worker");
+    lua_setmetatable(L, -2);
+
+    Worker* worker = calloc(1, sizeof(Worker));
+    strcpy(worker->script_path, script_path);
+    worker->running = 1;
+    pthread_mutex_init(&worker->lock, NULL);
+    pthread_cond_init(&worker->wake, NULL);
+
+    if (pthread_create(&worker->thread, NULL, worker_main, worker) != 0)
+    {
+        pthread_cond_destroy(&worker->wake);
+        pthread_mutex_destroy(&worker->lock);
+        free(worker);
+        return luaL_error(L, "worker_spawn failed to start a thread for \"%s\"", script_path);
+    }
+
+    handle->worker = worker;
+    return 1;
+}
+
+static int cmt_worker_send(lua_State* L)
+{
+    const WorkerHandle* handle = cmt_check_worker(L, 1);
+    luaL_checkany(L, 2);
+
+    WorkerMessage* message = encode_message(L, 2);
+    const bool sent = queue_push(&handle->worker->inbox, message);
+    if (sent)
+        worker_wake(handle->worker);
+    else
+        free(message);
+
+    lua_pushboolean(L, sent);
+    return 1;
+}
+
+static int cmt_worker_receive(lua_State* L)
+{
+    const WorkerHandle* handle = cmt_check_worker(L, 1);
+    WorkerMessage* message = queue_pop(&handle->worker->outbox);
+    if (message == NULL)
+        return 0;
+
+    const bool decoded = decode_message(L, message);
+    free(message);
+    return decoded ? 1 : 0;
+}
+
+static int cmt_worker_stop(lua_State* L)
+{
+    WorkerHandle* handle = luaL_checkudata(L, 1, "__mt_worker");
+    if (handle->worker != NULL)
+    {
+        worker_stop(handle->worker);
+        handle->worker = NULL;
+    }
+    return 0;
+}
+
+static int cmt_worker_index(lua_State* L)
+{
+    const WorkerHandle* handle = luaL_checkudata(L, 1, "__mt_worker");
+    const char* key = luaL_checkstring(L, 2);
+    const Worker* worker = handle->worker;
+
+    if (strcmp(key, "running") == 0)
+    {
+        lua_pushboolean(L, worker != NULL && __atomic_load_n(&worker->running, __ATOMIC_ACQUIRE));
+    }
+    else if (strcmp(key, "error") == 0)
+    {
+        if (worker != NULL && __atomic_load_n(&worker->failed, __ATOMIC_ACQUIRE))
+            lua_pushstring(L, worker->error);
+        else
+            lua_pushnil(L);
+    }
+    else
+    {
+        return luaL_error(L, "Worker has no field \"%s\".", key);
+    }
+
+    return 1;
+}
+
+void register_worker_bindings(lua_State* L)
+{
+    lua_register(L, "worker_spawn", cmt_worker_spawn);
+    lua_register(L, "worker_send", cmt_worker_send);
+    lua_register(L, "worker_receive", cmt_worker_receive);
+    lua_register(L, "worker_stop", cmt_worker_stop);
+
+    if (!luaL_newmetatable(L, "__mt_worker"))
+        printf("Lua error: Worker metatable at __mt_worker already exists\n");
+
+    lua_pushcfunction(L, cmt_worker_index);
+    lua_setfield(L, -2, "__index");
+    lua_pushcfunction(L, cmt_worker_stop);
+    lua_setfield(L, -2, "__gc");
+    lua_pop(L, 1);
+}
+
+#else
+
+static int cmt_worker_spawn(lua_State* L)
+{
+    return luaL_error(L, "worker_spawn is not supported without thread support");
+}
+
+void register_worker_bindings(lua_State* L)
+{
+    lua_register(L, "worker_spawn", cmt_worker_spawn);
+}
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef WORKER_H
+#define WORKER_H
+
+#include "comet.h"
+
+#define WORKER_QUEUE_CAPACITY 1024
+
+typedef struct WorkerMessage
+{
+    size_t size;
+    unsigned char data[];
+} WorkerMessage;
+
+// single producer single consumer ring, the only synchronisation is on head and tail
+typedef struct WorkerQueue
+{
+    WorkerMessage* slots[WORKER_QUEUE_CAPACITY];
+    volatile unsigned int head;
+    volatile unsigned int tail;
+} WorkerQueue;
+
+void register_worker_bindings(lua_State* L);
+
+#endif //WORKER_H